@@ -1,6 +1,7 @@
 #version 430 core
 
-uniform sampler2D textureSampler;
+uniform sampler2DArray textureSampler;
+uniform int textureLayer;
 uniform vec3 lightDir;
 
 in vec3 interpNormal;
@@ -9,7 +10,7 @@ in vec2 interpTexCoord;
 void main()
 {
 	vec2 modifiedTexCoord = vec2(interpTexCoord.x, 1.0 - interpTexCoord.y); // Poprawka dla tekstur Ziemi, ktore bez tego wyswietlaja sie 'do gory nogami'
-	vec3 color = texture2D(textureSampler, modifiedTexCoord).rgb;
+	vec3 color = texture(textureSampler, vec3(modifiedTexCoord, textureLayer)).rgb;
 	vec3 normal = normalize(interpNormal);
 	float ambient = 0.2;
 	float diffuse = max(dot(normal, -lightDir), 0.0);
@@ -2,17 +2,32 @@
 
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec2 vertexTexCoord;
-layout(location = 2) in vec3 vertexNormal;
+layout(location = 2) in vec2 vertexNormal;
 
 uniform mat4 modelViewProjectionMatrix;
 uniform mat4 modelMatrix;
 
+// packed vertices (see src/Packed_Mesh.h): position and texture coordinates are normalized to the
+// range of the mesh, the normal is encoded on an octahedron
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 texCoordOffset;
+uniform vec2 texCoordScale;
+
 out vec3 interpNormal;
 out vec2 interpTexCoord;
 
+vec3 decodeNormal(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
 void main()
 {
-	gl_Position = modelViewProjectionMatrix * vec4(vertexPosition, 1.0);
-	interpNormal = (modelMatrix * vec4(vertexNormal, 0.0)).xyz;
-	interpTexCoord = vertexTexCoord;
+	gl_Position = modelViewProjectionMatrix * vec4(positionOffset + positionScale * vertexPosition, 1.0);
+	interpNormal = (modelMatrix * vec4(decodeNormal(vertexNormal), 0.0)).xyz;
+	interpTexCoord = texCoordOffset + texCoordScale * vertexTexCoord;
 }
@@ -0,0 +1,111 @@
+#include "Bowling_Score.h"
+
+#include <cstddef>
+
+namespace
+{
+	const int allPins = Core::BowlingGame::numPins;
+
+	// Walks the frames of a game and returns the total of the frames it could score. Without
+	// checkAvailable the rolls are assumed to be complete, which keeps the loop free of the
+	// bounds checks for the batch scoring (and frameTotals is not written).
+	template <bool checkAvailable>
+	int ScoreRolls(const unsigned char * rolls, int numRolls, int * frameTotals)
+	{
+		int total = 0, r = 0;
+		for (int frame = 0; frame < Core::BowlingGame::numFrames; frame++)
+		{
+			int first = checkAvailable && r >= numRolls ? -1 : rolls[r];
+			int needed, taken;
+			if (first == allPins)
+			{
+				// strike: the next two balls are the bonus
+				needed = 3;
+				taken = 1;
+			}
+			else
+			{
+				int second = checkAvailable && r + 1 >= numRolls ? -1 : rolls[r + 1];
+				needed = first >= 0 && second >= 0 && first + second == allPins ? 3 : 2;
+				taken = 2;
+			}
+			if (checkAvailable && r + needed > numRolls)
+			{
+				for (; frame < Core::BowlingGame::numFrames; frame++)
+					frameTotals[frame] = -1;
+				break;
+			}
+			total += rolls[r] + rolls[r + 1] + (needed == 3 ? rolls[r + 2] : 0);
+			r += taken;
+			if (checkAvailable)
+				frameTotals[frame] = total;
+		}
+		return total;
+	}
+}
+
+void Core::ResetGame(BowlingGame & game)
+{
+	game = BowlingGame();
+	game.standing = allPins;
+}
+
+Core::RollResult Core::AddRoll(BowlingGame & game, int pins)
+{
+	if (IsGameOver(game)) return RollResult::GameOver;
+	if (pins < 0 || pins > game.standing) return RollResult::InvalidPins;
+
+	game.rolls[game.numRolls++] = (unsigned char)pins;
+	game.standing -= (unsigned char)pins;
+	bool lastFrame = game.frame == BowlingGame::numFrames - 1;
+
+	if (!lastFrame)
+	{
+		// a strike or the second ball ends the frame
+		if (game.standing == 0 || game.ball == 1)
+		{
+			game.frame++;
+			game.ball = 0;
+			game.standing = allPins;
+		}
+		else
+			game.ball = 1;
+		return RollResult::Accepted;
+	}
+
+	// 10th frame: a strike or spare earns more balls at a full rack, up to three in total
+	int frameStart = game.numRolls - 1 - game.ball;
+	int frameRolls = game.ball + 1;
+	bool bonus = game.rolls[frameStart] == allPins || (frameRolls >= 2 && game.rolls[frameStart] + game.rolls[frameStart + 1] == allPins);
+	if (frameRolls == 3 || (frameRolls == 2 && !bonus))
+	{
+		game.frame = BowlingGame::numFrames;
+		game.standing = 0;
+		return RollResult::Accepted;
+	}
+	game.ball++;
+	if (game.standing == 0)
+		game.standing = allPins;
+	return RollResult::Accepted;
+}
+
+bool Core::IsGameOver(const BowlingGame & game)
+{
+	return game.frame >= BowlingGame::numFrames;
+}
+
+bool Core::IsFreshRack(const BowlingGame & game)
+{
+	return !IsGameOver(game) && game.standing == allPins;
+}
+
+int Core::ScoreFrames(const BowlingGame & game, int frameTotals[BowlingGame::numFrames])
+{
+	return ScoreRolls<true>(game.rolls, game.numRolls, frameTotals);
+}
+
+void Core::ScoreGames(const unsigned char * rolls, int stride, const unsigned char * numRolls, int count, int * totals)
+{
+	for (int i = 0; i < count; i++)
+		totals[i] = ScoreRolls<false>(rolls + (size_t)i * stride, numRolls[i], nullptr);
+}
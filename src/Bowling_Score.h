@@ -0,0 +1,49 @@
+#pragma once
+
+namespace Core
+{
+	// Ten-pin bowling game: the pins knocked down by every ball, with the position in the game.
+	// Plain bytes with no pointers (25 bytes), so it can be copied, stored and sent around freely.
+	struct BowlingGame
+	{
+		static const int numFrames = 10;
+		static const int numPins = 10;
+		// 9 frames of at most 2 balls and the 10th of at most 3
+		static const int maxRolls = 21;
+
+		unsigned char rolls[maxRolls];
+		unsigned char numRolls;
+		// frame the next ball belongs to (numFrames once the game is over) and the ball in it
+		unsigned char frame;
+		unsigned char ball;
+		// pins standing for the next ball
+		unsigned char standing;
+	};
+
+	enum class RollResult
+	{
+		Accepted,
+		// more pins than are standing
+		InvalidPins,
+		GameOver
+	};
+
+	void ResetGame(BowlingGame & game);
+
+	// Records a ball that knocked down pins of the ones standing.
+	RollResult AddRoll(BowlingGame & game, int pins);
+
+	bool IsGameOver(const BowlingGame & game);
+
+	// True when the next ball is thrown at a full rack (new frame, or the bonus balls of the 10th).
+	bool IsFreshRack(const BowlingGame & game);
+
+	// Running total after each frame, -1 for frames not finished yet or still waiting for the balls
+	// of a strike or spare bonus. Returns the total of the frames that are scored.
+	int ScoreFrames(const BowlingGame & game, int frameTotals[BowlingGame::numFrames]);
+
+	// Scores count recorded games at once, e.g. for league statistics. Game i has numRolls[i] rolls
+	// starting at rolls + i * stride; the rolls have to come from complete games (as accepted by
+	// AddRoll), they are not validated. Writes the final score of each game to totals.
+	void ScoreGames(const unsigned char * rolls, int stride, const unsigned char * numRolls, int count, int * totals);
+}
@@ -0,0 +1,80 @@
+#include "Bowling_Session.h"
+
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+	void StartGame(Core::SessionBowler & bowler)
+	{
+		Core::ResetGame(bowler.game);
+		bowler.gameId = Core::NewScoreGameId();
+	}
+
+	void AppendScore(const Core::LaneSession & lane, const Core::SessionBowler & bowler, Core::ScoreRecordType type, int score)
+	{
+		Core::ScoreRecord record = {};
+		record.gameId = bowler.gameId;
+		record.time = (unsigned)time(nullptr);
+		memcpy(record.bowler, bowler.name, sizeof(record.bowler));
+		record.type = type;
+		record.lane = (unsigned char)lane.lane;
+		record.frames = bowler.game.frame;
+		record.numRolls = bowler.game.numRolls;
+		memcpy(record.rolls, bowler.game.rolls, sizeof(record.rolls));
+		record.score = (short)score;
+		Core::AppendScoreRecord(record);
+	}
+}
+
+int Core::AddSessionLane(BowlingSession & session, int lane)
+{
+	LaneSession laneSession;
+	laneSession.lane = lane;
+	laneSession.up = 0;
+	session.lanes.push_back(laneSession);
+	return (int)session.lanes.size() - 1;
+}
+
+void Core::AddSessionBowler(BowlingSession & session, int laneIndex, const char * name)
+{
+	SessionBowler bowler;
+	ScoreRecord record;
+	SetRecordBowler(record, name);
+	memcpy(bowler.name, record.bowler, sizeof(bowler.name));
+	bowler.gamesPlayed = 0;
+	StartGame(bowler);
+	session.lanes[laneIndex].bowlers.push_back(bowler);
+}
+
+Core::SessionRoll Core::AddSessionRoll(BowlingSession & session, int laneIndex, int pins)
+{
+	LaneSession & lane = session.lanes[laneIndex];
+	SessionBowler & bowler = lane.bowlers[lane.up];
+	SessionRoll roll = {};
+	roll.bowler = lane.up;
+	roll.frame = bowler.game.frame;
+	roll.result = AddRoll(bowler.game, pins);
+	if (roll.result != RollResult::Accepted) return roll;
+
+	int frameTotals[BowlingGame::numFrames];
+	roll.score = ScoreFrames(bowler.game, frameTotals);
+	roll.gameOver = IsGameOver(bowler.game);
+	roll.frameOver = roll.gameOver || bowler.game.frame != roll.frame;
+	if (!roll.frameOver) return roll;
+
+	AppendScore(lane, bowler, roll.gameOver ? ScoreRecordType::Game : ScoreRecordType::Frame, roll.score);
+	if (roll.gameOver)
+	{
+		bowler.gamesPlayed++;
+		StartGame(bowler);
+	}
+	lane.up = (lane.up + 1) % (int)lane.bowlers.size();
+	return roll;
+}
+
+const Core::SessionBowler & Core::GetBowlerUp(const BowlingSession & session, int laneIndex)
+{
+	const LaneSession & lane = session.lanes[laneIndex];
+	return lane.bowlers[lane.up];
+}
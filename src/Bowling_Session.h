@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+
+#include "Bowling_Score.h"
+#include "Score_Log.h"
+
+namespace Core
+{
+	struct SessionBowler
+	{
+		// as written to the score log, see SetRecordBowler
+		char name[ScoreRecord::maxName];
+		BowlingGame game;
+		unsigned gameId;
+		int gamesPlayed;
+	};
+
+	// Bowlers sharing a lane, taking turns frame by frame.
+	struct LaneSession
+	{
+		// lane number of the bowling center, stored with the scores
+		int lane;
+		std::vector<SessionBowler> bowlers;
+		// the bowler throwing next
+		int up;
+	};
+
+	// All lanes run by this host. Completed frames and games are sent to the score log
+	// (StartScoreLog), a finished game is followed by a new one for the same bowler.
+	struct BowlingSession
+	{
+		std::vector<LaneSession> lanes;
+	};
+
+	struct SessionRoll
+	{
+		RollResult result;
+		// the bowler who threw the ball and the frame it belonged to
+		int bowler;
+		int frame;
+		// total of the frames scored so far, the final score when the game is over
+		int score;
+		bool frameOver;
+		bool gameOver;
+	};
+
+	// Returns the index of the lane in session.lanes.
+	int AddSessionLane(BowlingSession & session, int lane);
+
+	void AddSessionBowler(BowlingSession & session, int laneIndex, const char * name);
+
+	// Scores a ball of the bowler up on the lane. The next bowler is up once the frame is over.
+	SessionRoll AddSessionRoll(BowlingSession & session, int laneIndex, int pins);
+
+	const SessionBowler & GetBowlerUp(const BowlingSession & session, int laneIndex);
+}
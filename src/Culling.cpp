@@ -0,0 +1,61 @@
+#include "Culling.h"
+
+#include <algorithm>
+
+Core::Bounds Core::ComputeBounds(const obj::Model & model)
+{
+	Bounds bounds;
+	bounds.min = glm::vec3(0.0f);
+	bounds.max = glm::vec3(0.0f);
+	for (size_t i = 0; i + 2 < model.vertex.size(); i += 3)
+	{
+		glm::vec3 v(model.vertex[i], model.vertex[i + 1], model.vertex[i + 2]);
+		bounds.min = i == 0 ? v : glm::min(bounds.min, v);
+		bounds.max = i == 0 ? v : glm::max(bounds.max, v);
+	}
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+
+	// the box center is not the best sphere center, but a tight radius around it is good enough
+	float radius2 = 0.0f;
+	for (size_t i = 0; i + 2 < model.vertex.size(); i += 3)
+	{
+		glm::vec3 d = glm::vec3(model.vertex[i], model.vertex[i + 1], model.vertex[i + 2]) - bounds.center;
+		radius2 = std::max(radius2, glm::dot(d, d));
+	}
+	bounds.radius = sqrtf(radius2);
+	return bounds;
+}
+
+Core::Frustum Core::ExtractFrustum(const glm::mat4 & viewProjection)
+{
+	// rows of the matrix combined as in Gribb & Hartmann
+	glm::mat4 m = glm::transpose(viewProjection);
+	Frustum frustum;
+	frustum.planes[0] = m[3] + m[0];
+	frustum.planes[1] = m[3] - m[0];
+	frustum.planes[2] = m[3] + m[1];
+	frustum.planes[3] = m[3] - m[1];
+	frustum.planes[4] = m[3] + m[2];
+	frustum.planes[5] = m[3] - m[2];
+	for (int i = 0; i < 6; i++)
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+	return frustum;
+}
+
+bool Core::IsSphereVisible(const Frustum & frustum, const glm::vec3 & center, float radius)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius)
+			return false;
+	}
+	return true;
+}
+
+void Core::TransformBounds(const Bounds & bounds, const glm::mat4 & model, glm::vec3 & center, float & radius)
+{
+	center = glm::vec3(model * glm::vec4(bounds.center, 1.0f));
+	float scale2 = std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+		std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+	radius = bounds.radius * sqrtf(scale2);
+}
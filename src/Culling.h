@@ -0,0 +1,31 @@
+#pragma once
+
+#include "glm.hpp"
+#include "objload.h"
+
+namespace Core
+{
+	// Axis aligned box and bounding sphere of a mesh in its own coordinates.
+	struct Bounds
+	{
+		glm::vec3 min, max;
+		glm::vec3 center;
+		float radius;
+	};
+
+	Bounds ComputeBounds(const obj::Model & model);
+
+	// Six planes (left, right, bottom, top, near, far) with normals pointing inside.
+	struct Frustum
+	{
+		glm::vec4 planes[6];
+	};
+
+	// Planes of the view volume of viewProjection, in the space the matrix transforms from.
+	Frustum ExtractFrustum(const glm::mat4 & viewProjection);
+
+	bool IsSphereVisible(const Frustum & frustum, const glm::vec3 & center, float radius);
+
+	// Bounding sphere of the mesh after the model transform (which may contain a non-uniform scale).
+	void TransformBounds(const Bounds & bounds, const glm::mat4 & model, glm::vec3 & center, float & radius);
+}
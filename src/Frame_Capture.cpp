@@ -0,0 +1,192 @@
+#include "Frame_Capture.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "SOIL/SOIL.h"
+#include "Logger.h"
+
+using namespace Core;
+
+FrameCapture::FrameCapture()
+	: width(0), height(0), imageSequence(false), stream(nullptr), framebuffer(0), colorBuffer(0), depthBuffer(0),
+	framesRendered(0), framesWritten(0), writerRunning(false)
+{
+	memset(pixelBuffers, 0, sizeof(pixelBuffers));
+}
+
+FrameCapture::~FrameCapture()
+{
+	Finish();
+}
+
+bool FrameCapture::Init(int width, int height, const char * output)
+{
+	this->width = width;
+	this->height = height;
+	this->output = output;
+	imageSequence = this->output.find('%') != std::string::npos;
+	if (!imageSequence)
+	{
+		stream = fopen(output, "wb");
+		if (!stream)
+		{
+			Log(LogLevel::Error, "capture: can't open %s", output);
+			return false;
+		}
+	}
+
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		Log(LogLevel::Error, "capture: framebuffer incomplete (0x%x)", status);
+		Release();
+		return false;
+	}
+
+	glGenBuffers(numPixelBuffers, pixelBuffers);
+	for (int i = 0; i < numPixelBuffers; i++)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	writerRunning = true;
+	writer = std::thread(&FrameCapture::WriteFrames, this);
+	Log(LogLevel::Info, "capture: rendering %dx%d offscreen to %s", width, height, output);
+	return true;
+}
+
+void FrameCapture::BeginFrame()
+{
+	glGetIntegerv(GL_VIEWPORT, previousViewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glViewport(0, 0, width, height);
+}
+
+void FrameCapture::EndFrame()
+{
+	int current = framesRendered % numPixelBuffers;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[current]);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+	// the buffer filled two frames ago has had time to arrive
+	int oldest = framesRendered - (numPixelBuffers - 1);
+	if (oldest >= 0)
+		QueueFrame(oldest % numPixelBuffers, oldest);
+	framesRendered++;
+}
+
+void FrameCapture::QueueFrame(int pixelBuffer, int index)
+{
+	Frame * frame = new Frame;
+	frame->index = index;
+	frame->pixels.resize(width * height * 4);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[pixelBuffer]);
+	void * mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width * height * 4, GL_MAP_READ_BIT);
+	if (mapped)
+	{
+		memcpy(&frame->pixels[0], mapped, frame->pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// batch rendering must not lose frames, so a slow disk slows the renderer down instead
+	while (!writeQueue.Push(frame))
+		std::this_thread::yield();
+}
+
+void FrameCapture::Finish()
+{
+	if (!writerRunning) return;
+
+	int first = framesRendered - (numPixelBuffers - 1);
+	for (int index = first < 0 ? 0 : first; index < framesRendered; index++)
+		QueueFrame(index % numPixelBuffers, index);
+
+	writerRunning = false;
+	writer.join();
+	Release();
+	Log(LogLevel::Info, "capture: %d frames written to %s", framesWritten.load(), output.c_str());
+}
+
+void FrameCapture::Release()
+{
+	if (stream)
+	{
+		fclose(stream);
+		stream = nullptr;
+	}
+
+	// zero names are ignored, so this also works after Init gave up half way
+	glDeleteBuffers(numPixelBuffers, pixelBuffers);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &colorBuffer);
+	glDeleteRenderbuffers(1, &depthBuffer);
+	memset(pixelBuffers, 0, sizeof(pixelBuffers));
+	framebuffer = colorBuffer = depthBuffer = 0;
+}
+
+void FrameCapture::WriteFrames()
+{
+	Frame * frame;
+	for (;;)
+	{
+		if (writeQueue.Pop(frame))
+		{
+			WriteFrame(*frame);
+			delete frame;
+			framesWritten++;
+		}
+		else if (!writerRunning)
+			break;
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void FrameCapture::WriteFrame(Frame & frame)
+{
+	// OpenGL returns the rows bottom-up
+	std::vector<unsigned char> row(width * 4);
+	for (int y = 0; y < height / 2; y++)
+	{
+		unsigned char * top = &frame.pixels[y * width * 4];
+		unsigned char * bottom = &frame.pixels[(height - 1 - y) * width * 4];
+		memcpy(&row[0], top, row.size());
+		memcpy(top, bottom, row.size());
+		memcpy(bottom, &row[0], row.size());
+	}
+
+	if (!imageSequence)
+	{
+		fwrite(&frame.pixels[0], 1, frame.pixels.size(), stream);
+		return;
+	}
+
+	char filename[512];
+	snprintf(filename, sizeof(filename), output.c_str(), frame.index);
+	size_t length = strlen(filename);
+	int type = length > 4 && strcmp(filename + length - 4, ".bmp") == 0 ? SOIL_SAVE_TYPE_BMP : SOIL_SAVE_TYPE_TGA;
+	if (!SOIL_save_image(filename, type, width, height, 4, &frame.pixels[0]))
+		Log(LogLevel::Error, "capture: can't write %s", filename);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glew.h"
+#include "freeglut.h"
+#include "Ring_Buffer.h"
+
+namespace Core
+{
+	// Offscreen rendering into a framebuffer object with asynchronous read-back.
+	// Frames are copied out through a ring of pixel pack buffers (read two frames late, so the GPU
+	// never has to be waited for) and written by a background thread, either as an image sequence
+	// (output contains a printf pattern, e.g. "capture/frame_%05d.tga"; .tga and .bmp are supported)
+	// or as a raw RGBA stream to a file or named pipe (any other output path).
+	class FrameCapture
+	{
+	public:
+		FrameCapture();
+		~FrameCapture();
+
+		bool Init(int width, int height, const char * output);
+
+		// Redirects rendering into the offscreen framebuffer.
+		void BeginFrame();
+
+		// Starts the read-back of the frame and queues the oldest finished one for writing.
+		void EndFrame();
+
+		// Reads back the frames still in flight and waits for the writer thread.
+		void Finish();
+
+		int GetFramesWritten() const { return framesWritten; }
+
+	private:
+		struct Frame
+		{
+			int index;
+			std::vector<unsigned char> pixels;
+		};
+
+		static const int numPixelBuffers = 3;
+
+		void QueueFrame(int pixelBuffer, int index);
+		// closes the output and deletes the GL objects
+		void Release();
+		void WriteFrames();
+		void WriteFrame(Frame & frame);
+
+		int width, height;
+		std::string output;
+		bool imageSequence;
+		FILE * stream;
+
+		GLuint framebuffer, colorBuffer, depthBuffer;
+		GLuint pixelBuffers[numPixelBuffers];
+		GLint previousViewport[4];
+		int framesRendered;
+		std::atomic<int> framesWritten;
+
+		RingBuffer<Frame *, 16> writeQueue;
+		std::thread writer;
+		std::atomic<bool> writerRunning;
+	};
+}
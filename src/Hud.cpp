@@ -0,0 +1,55 @@
+#include "Hud.h"
+
+#include <cstdio>
+
+#include "glew.h"
+#include "freeglut.h"
+#include "Ring_Buffer.h"
+
+namespace
+{
+	struct HudEvent
+	{
+		Core::HudField field;
+		int value;
+		bool visible;
+	};
+
+	const int numFields = (int)Core::HudField::Count;
+	const char * fieldNames[numFields] = { "Player", "Frame", "Ball", "Pins down", "Score" };
+
+	Core::RingBuffer<HudEvent, 64> events;
+	int values[numFields];
+	bool visible[numFields];
+}
+
+void Core::PostHudEvent(HudField field, int value)
+{
+	events.Push({ field, value, true });
+}
+
+void Core::ClearHudField(HudField field)
+{
+	events.Push({ field, 0, false });
+}
+
+void Core::DrawHud(float x, float y)
+{
+	HudEvent e;
+	while (events.Pop(e))
+	{
+		values[(int)e.field] = e.value;
+		visible[(int)e.field] = e.visible;
+	}
+
+	char line[64];
+	glColor3f(1.0f, 1.0f, 1.0f);
+	for (int i = 0; i < numFields; i++)
+	{
+		if (!visible[i]) continue;
+		snprintf(line, sizeof(line), "%s: %d", fieldNames[i], values[i]);
+		glRasterPos2f(x, y);
+		glutBitmapString(GLUT_BITMAP_HELVETICA_18, (const unsigned char *)line);
+		y += 22.f;
+	}
+}
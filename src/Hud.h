@@ -0,0 +1,26 @@
+#pragma once
+
+namespace Core
+{
+	// Values shown in the on-screen HUD.
+	enum class HudField
+	{
+		Player,
+		Frame,
+		Ball,
+		PinsDown,
+		Score,
+		Count
+	};
+
+	// Queues a HUD update. Safe to call from any thread and never blocks,
+	// the value becomes visible after the next DrawHud().
+	void PostHudEvent(HudField field, int value);
+
+	// Clears a field so it is no longer drawn.
+	void ClearHudField(HudField field);
+
+	// Applies queued events and draws the HUD text. Has to be called from the GL thread
+	// while an orthographic projection with (0,0) in the top-left corner is active.
+	void DrawHud(float x, float y);
+}
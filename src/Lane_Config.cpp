@@ -0,0 +1,193 @@
+#include "Lane_Config.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Logger.h"
+
+namespace
+{
+	// plain arrays are constant initialized, GetDefaultLaneConfig can run before the dynamic
+	// initializers of this file (a global LaneConfig elsewhere)
+	const float defaultRackOffset[3] = { 21.0f, 0.0f, 0.0f };
+	// pin i of the rack, pin 0 is the head pin
+	const float defaultPinPositions[Core::LaneConfig::numPins][3] = {
+		{ 3.0f, 0.25f, 0.0f },
+		{ 3.5f, 0.25f, -0.25f },
+		{ 3.5f, 0.25f, 0.25f },
+		{ 4.0f, 0.25f, 0.0f },
+		{ 4.0f, 0.25f, -0.5f },
+		{ 4.0f, 0.25f, 0.5f },
+		{ 4.5f, 0.25f, -0.25f },
+		{ 4.5f, 0.25f, -0.75f },
+		{ 4.5f, 0.25f, 0.25f },
+		{ 4.5f, 0.25f, 0.75f }
+	};
+
+	glm::vec3 DefaultRackOffset()
+	{
+		return glm::vec3(defaultRackOffset[0], defaultRackOffset[1], defaultRackOffset[2]);
+	}
+
+	struct Field
+	{
+		std::string key;
+		float * values;
+		int count;
+	};
+
+	void AddMaterialFields(std::vector<Field> & fields, const std::string & prefix, Core::MaterialConfig & material)
+	{
+		fields.push_back({ prefix + ".static_friction", &material.staticFriction, 1 });
+		fields.push_back({ prefix + ".dynamic_friction", &material.dynamicFriction, 1 });
+		fields.push_back({ prefix + ".restitution", &material.restitution, 1 });
+	}
+
+	std::string Trim(const std::string & text)
+	{
+		size_t begin = text.find_first_not_of(" \t\r");
+		size_t end = text.find_last_not_of(" \t\r");
+		return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+	}
+}
+
+Core::LaneConfig Core::GetDefaultLaneConfig()
+{
+	LaneConfig config;
+	config.ballSize = glm::vec3(0.7f);
+	config.ballPosition = glm::vec3(-30.0f, 0.25f, 0.0f);
+	config.ballMass = 8.0f;
+	config.ballMaterial = { 3.0f, 10.0f, 0.01f };
+	config.pinSize = glm::vec3(0.3f);
+	config.pinMass = 0.2f;
+	config.pinMaterial = { 5.0f, 5.0f, 0.2f };
+	for (int i = 0; i < LaneConfig::numPins; i++)
+		config.pinPositions[i] = DefaultRackOffset() + glm::vec3(defaultPinPositions[i][0], defaultPinPositions[i][1], defaultPinPositions[i][2]);
+	config.groundSize = glm::vec3(6.0f);
+	return config;
+}
+
+bool Core::LoadLaneConfig(LaneConfig & config, const char * filepath, bool required)
+{
+	std::ifstream file(filepath);
+	if (!file.good())
+	{
+		if (required)
+		{
+			Log(LogLevel::Error, "lane config: can't open %s", filepath);
+			return false;
+		}
+		Log(LogLevel::Warning, "lane config: can't open %s, using the defaults", filepath);
+		return true;
+	}
+
+	// the pins are read relative to the rack and placed once the offset is known
+	LaneConfig loaded = config;
+	glm::vec3 rackOffset = DefaultRackOffset();
+	glm::vec3 pinPositions[LaneConfig::numPins];
+	for (int i = 0; i < LaneConfig::numPins; i++)
+		pinPositions[i] = config.pinPositions[i] - DefaultRackOffset();
+
+	std::vector<Field> fields = {
+		{ "ball.size", &loaded.ballSize[0], 3 },
+		{ "ball.position", &loaded.ballPosition[0], 3 },
+		{ "ball.mass", &loaded.ballMass, 1 },
+		{ "pin.size", &loaded.pinSize[0], 3 },
+		{ "pin.mass", &loaded.pinMass, 1 },
+		{ "rack.offset", &rackOffset[0], 3 },
+		{ "ground.size", &loaded.groundSize[0], 3 }
+	};
+	AddMaterialFields(fields, "ball.material", loaded.ballMaterial);
+	AddMaterialFields(fields, "pin.material", loaded.pinMaterial);
+	for (int i = 0; i < LaneConfig::numPins; i++)
+		fields.push_back({ "pin." + std::to_string(i), &pinPositions[i][0], 3 });
+
+	bool valid = true;
+	std::string line;
+	for (int lineNumber = 1; std::getline(file, line); lineNumber++)
+	{
+		line = Trim(line.substr(0, line.find('#')));
+		if (line.empty()) continue;
+		size_t equals = line.find('=');
+		std::string key = Trim(line.substr(0, equals));
+		auto field = std::find_if(fields.begin(), fields.end(), [&](const Field & f) { return f.key == key; });
+		if (equals == std::string::npos || field == fields.end())
+		{
+			Log(LogLevel::Error, "lane config: %s:%d: unknown setting '%s'", filepath, lineNumber, key.c_str());
+			valid = false;
+			continue;
+		}
+
+		std::istringstream values(line.substr(equals + 1));
+		float parsed[3];
+		int count = 0;
+		while (count < 3 && values >> parsed[count]) count++;
+		std::string rest;
+		if (count != field->count || (values.clear(), values >> rest))
+		{
+			Log(LogLevel::Error, "lane config: %s:%d: '%s' takes %d number(s)", filepath, lineNumber, key.c_str(), field->count);
+			valid = false;
+			continue;
+		}
+		std::copy(parsed, parsed + count, field->values);
+	}
+
+	for (int i = 0; i < LaneConfig::numPins; i++)
+		loaded.pinPositions[i] = rackOffset + pinPositions[i];
+	// validated even after a parse error, to report everything at once
+	if (!ValidateLaneConfig(loaded) || !valid)
+		return false;
+	config = loaded;
+	Log(LogLevel::Info, "lane config: loaded %s", filepath);
+	return true;
+}
+
+bool Core::ValidateLaneConfig(const LaneConfig & config)
+{
+	bool valid = true;
+	auto check = [&](bool condition, const char * message) {
+		if (!condition)
+		{
+			Log(LogLevel::Error, "lane config: %s", message);
+			valid = false;
+		}
+	};
+	auto checkMaterial = [&](const MaterialConfig & material, const char * message) {
+		check(material.staticFriction >= 0.0f && material.dynamicFriction >= 0.0f
+			&& material.restitution >= 0.0f && material.restitution <= 1.0f, message);
+	};
+
+	check(glm::min(config.ballSize.x, glm::min(config.ballSize.y, config.ballSize.z)) > 0.0f, "ball.size has to be positive");
+	check(config.ballMass > 0.0f, "ball.mass has to be positive");
+	checkMaterial(config.ballMaterial, "ball.material needs non-negative friction and restitution in 0..1");
+	check(glm::min(config.pinSize.x, glm::min(config.pinSize.y, config.pinSize.z)) > 0.0f, "pin.size has to be positive");
+	check(config.pinMass > 0.0f, "pin.mass has to be positive");
+	checkMaterial(config.pinMaterial, "pin.material needs non-negative friction and restitution in 0..1");
+	check(glm::min(config.groundSize.x, glm::min(config.groundSize.y, config.groundSize.z)) > 0.0f, "ground.size has to be positive");
+
+	float rackStart = config.pinPositions[0].x;
+	for (int i = 0; i < LaneConfig::numPins; i++)
+	{
+		const glm::vec3 & pin = config.pinPositions[i];
+		rackStart = std::min(rackStart, pin.x);
+		if (pin.y < 0.0f)
+		{
+			Log(LogLevel::Error, "lane config: pin.%d is below the lane", i);
+			valid = false;
+		}
+		for (int j = 0; j < i; j++)
+		{
+			if (glm::length(glm::vec2(pin.x - config.pinPositions[j].x, pin.z - config.pinPositions[j].z)) < config.pinSize.x)
+			{
+				Log(LogLevel::Error, "lane config: pin.%d and pin.%d overlap", j, i);
+				valid = false;
+			}
+		}
+	}
+	check(config.ballPosition.y >= 0.0f, "ball.position is below the lane");
+	check(config.ballPosition.x + config.ballSize.x * 0.5f < rackStart, "ball.position has to be in front of the rack");
+	return valid;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "glm.hpp"
+
+namespace Core
+{
+	struct MaterialConfig
+	{
+		float staticFriction;
+		float dynamicFriction;
+		float restitution;
+	};
+
+	// Lane, rack and material parameters, read once at startup (see config/lane.cfg).
+	struct LaneConfig
+	{
+		static const int numPins = 10;
+
+		glm::vec3 ballSize;
+		glm::vec3 ballPosition;
+		float ballMass;
+		MaterialConfig ballMaterial;
+
+		glm::vec3 pinSize;
+		float pinMass;
+		MaterialConfig pinMaterial;
+		// absolute, the file gives them relative to rack.offset
+		glm::vec3 pinPositions[numPins];
+
+		// scale of the rendered lane
+		glm::vec3 groundSize;
+	};
+
+	// The values the game was tuned with, also what config/lane.cfg ships with.
+	LaneConfig GetDefaultLaneConfig();
+
+	// Reads "key = values" lines (# starts a comment) over the defaults. Returns false, with the
+	// reasons logged, if the file is malformed or the values are invalid; config is untouched then.
+	// A missing file keeps the defaults, unless it is required (a path the user gave explicitly).
+	bool LoadLaneConfig(LaneConfig & config, const char * filepath, bool required = false);
+
+	// Checks the values are physically sensible: positive sizes and masses, friction and restitution
+	// in range, pins standing on the lane apart from each other and the ball in front of the rack.
+	bool ValidateLaneConfig(const LaneConfig & config);
+}
@@ -0,0 +1,114 @@
+#include "Logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <thread>
+
+#include "Ring_Buffer.h"
+
+namespace
+{
+	struct LogEntry
+	{
+		Core::LogLevel level;
+		double time;
+		char text[240];
+	};
+
+	const char * levelNames[] = { "debug", "info", "warning", "error" };
+
+	typedef std::chrono::steady_clock Clock;
+
+	class Logger
+	{
+	public:
+		Logger() : running(false), minLevel((int)Core::LogLevel::Info), dropped(0), startTime(Clock::now()) {}
+		~Logger() { Stop(); }
+
+		void Start()
+		{
+			if (running.exchange(true)) return;
+			worker = std::thread(&Logger::Run, this);
+		}
+
+		void Stop()
+		{
+			if (!running.exchange(false)) return;
+			worker.join();
+		}
+
+		void Run()
+		{
+			while (running.load(std::memory_order_relaxed))
+			{
+				if (!Flush())
+					std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			}
+			Flush();
+		}
+
+		bool Flush()
+		{
+			LogEntry entry;
+			bool any = false;
+			while (queue.Pop(entry))
+			{
+				FILE * out = entry.level >= Core::LogLevel::Warning ? stderr : stdout;
+				fprintf(out, "[%8.3f] %-7s %s\n", entry.time, levelNames[(int)entry.level], entry.text);
+				any = true;
+			}
+			if (any)
+				fflush(stdout);
+			return any;
+		}
+
+		Core::RingBuffer<LogEntry, 1024> queue;
+		std::thread worker;
+		std::atomic<bool> running;
+		std::atomic<int> minLevel;
+		std::atomic<unsigned> dropped;
+		Clock::time_point startTime;
+	};
+
+	Logger logger;
+}
+
+void Core::StartLogger(LogLevel minLevel)
+{
+	SetLogLevel(minLevel);
+	logger.Start();
+}
+
+void Core::StopLogger()
+{
+	logger.Stop();
+}
+
+void Core::SetLogLevel(LogLevel minLevel)
+{
+	logger.minLevel.store((int)minLevel, std::memory_order_relaxed);
+}
+
+void Core::Log(LogLevel level, const char * format, ...)
+{
+	if ((int)level < logger.minLevel.load(std::memory_order_relaxed)) return;
+
+	LogEntry entry;
+	entry.level = level;
+	entry.time = std::chrono::duration<double>(Clock::now() - logger.startTime).count();
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(entry.text, sizeof(entry.text), format, args);
+	va_end(args);
+
+	if (!logger.queue.Push(entry))
+		logger.dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+unsigned Core::GetDroppedLogCount()
+{
+	return logger.dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+namespace Core
+{
+	enum class LogLevel
+	{
+		Debug,
+		Info,
+		Warning,
+		Error
+	};
+
+	// Starts the background thread which flushes queued messages to the console.
+	// Messages logged before StartLogger() stay queued until the thread runs.
+	void StartLogger(LogLevel minLevel = LogLevel::Info);
+
+	// Flushes what is left in the queue and joins the background thread.
+	void StopLogger();
+
+	void SetLogLevel(LogLevel minLevel);
+
+	// printf-style logging. Safe to call from any thread, never blocks and never touches the console
+	// itself - the message is formatted into a fixed-size slot of a lock-free ring buffer.
+	// If the buffer is full the message is dropped and counted (see GetDroppedLogCount).
+	void Log(LogLevel level, const char * format, ...);
+
+	unsigned GetDroppedLogCount();
+}
@@ -0,0 +1,160 @@
+#include "Mesh_Cache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "Logger.h"
+
+namespace
+{
+	// file layout: header, bounds, then per level a LevelHeader followed by
+	// the positions, texture coordinates, normals and indices
+	struct CacheHeader
+	{
+		unsigned magic;
+		unsigned version;
+		unsigned long long sourceHash;
+		int numLevels;
+	};
+
+	struct LevelHeader
+	{
+		float error;
+		float acmrBefore, acmrAfter;
+		int numVertices;
+		int numIndices;
+		float positionOffset[3], positionScale[3];
+		float texCoordOffset[2], texCoordScale[2];
+	};
+
+	const unsigned cacheMagic = ('G' << 0) | ('R' << 8) | ('K' << 16) | ('M' << 24);
+	// has to change together with anything that changes the processed meshes
+	const unsigned cacheVersion = 3;
+
+	unsigned long long Fnv1a(unsigned long long hash, const char * data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	void MakeDirectory(const std::string & path)
+	{
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	std::string CachePath(const char * cacheDirectory, unsigned long long hash)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.mesh", hash);
+		return std::string(cacheDirectory) + "/" + name;
+	}
+
+	template <typename T>
+	bool ReadArray(std::ifstream & file, std::vector<T> & data, int count)
+	{
+		data.resize(count);
+		return count == 0 || file.read((char *)&data[0], count * sizeof(T));
+	}
+
+	template <typename T>
+	void WriteArray(std::ofstream & file, const std::vector<T> & data)
+	{
+		if (!data.empty())
+			file.write((const char *)&data[0], data.size() * sizeof(T));
+	}
+
+	bool ReadCache(Core::LodMesh & mesh, const std::string & path, unsigned long long hash, int numLevels)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.good()) return false;
+
+		CacheHeader header;
+		if (!file.read((char *)&header, sizeof(header)) || header.magic != cacheMagic || header.version != cacheVersion
+			|| header.sourceHash != hash || header.numLevels != numLevels)
+			return false;
+		if (!file.read((char *)&mesh.bounds, sizeof(mesh.bounds)))
+			return false;
+
+		mesh.numLevels = numLevels;
+		for (int level = 0; level < numLevels; level++)
+		{
+			LevelHeader levelHeader;
+			Core::PackedModel & model = mesh.levels[level];
+			if (!file.read((char *)&levelHeader, sizeof(levelHeader))
+				|| !ReadArray(file, model.vertices, levelHeader.numVertices)
+				|| !ReadArray(file, model.indices, levelHeader.numIndices))
+				return false;
+			model.positionOffset = glm::vec3(levelHeader.positionOffset[0], levelHeader.positionOffset[1], levelHeader.positionOffset[2]);
+			model.positionScale = glm::vec3(levelHeader.positionScale[0], levelHeader.positionScale[1], levelHeader.positionScale[2]);
+			model.texCoordOffset = glm::vec2(levelHeader.texCoordOffset[0], levelHeader.texCoordOffset[1]);
+			model.texCoordScale = glm::vec2(levelHeader.texCoordScale[0], levelHeader.texCoordScale[1]);
+			mesh.errors[level] = levelHeader.error;
+			mesh.acmrBefore[level] = levelHeader.acmrBefore;
+			mesh.acmrAfter[level] = levelHeader.acmrAfter;
+		}
+		return true;
+	}
+
+	void WriteCache(const Core::LodMesh & mesh, const char * cacheDirectory, const std::string & path, unsigned long long hash)
+	{
+		MakeDirectory(cacheDirectory);
+		std::ofstream file(path, std::ios::binary);
+
+		CacheHeader header = { cacheMagic, cacheVersion, hash, mesh.numLevels };
+		file.write((const char *)&header, sizeof(header));
+		file.write((const char *)&mesh.bounds, sizeof(mesh.bounds));
+		for (int level = 0; level < mesh.numLevels; level++)
+		{
+			const Core::PackedModel & model = mesh.levels[level];
+			LevelHeader levelHeader = { mesh.errors[level], mesh.acmrBefore[level], mesh.acmrAfter[level], (int)model.vertices.size(), (int)model.indices.size(),
+				{ model.positionOffset.x, model.positionOffset.y, model.positionOffset.z }, { model.positionScale.x, model.positionScale.y, model.positionScale.z },
+				{ model.texCoordOffset.x, model.texCoordOffset.y }, { model.texCoordScale.x, model.texCoordScale.y } };
+			file.write((const char *)&levelHeader, sizeof(levelHeader));
+			WriteArray(file, model.vertices);
+			WriteArray(file, model.indices);
+		}
+		if (!file.good())
+			Core::Log(Core::LogLevel::Warning, "mesh cache: can't write %s", path.c_str());
+	}
+}
+
+void Core::LoadLodMesh(LodMesh & mesh, const char * filepath, int numLevels, const char * cacheDirectory)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::ifstream in(filepath);
+	std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (source.empty())
+		Log(LogLevel::Error, "mesh cache: can't read %s", filepath);
+
+	unsigned long long hash = Fnv1a(14695981039346656037ull, source.data(), source.size());
+	hash = Fnv1a(hash, (const char *)&numLevels, sizeof(numLevels));
+	hash = Fnv1a(hash, (const char *)&cacheVersion, sizeof(cacheVersion));
+	std::string path = CachePath(cacheDirectory, hash);
+
+	if (ReadCache(mesh, path, hash, numLevels))
+	{
+		Log(LogLevel::Info, "mesh cache: %s loaded in %.2f ms", filepath,
+			std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		return;
+	}
+
+	BuildLodMesh(mesh, obj::loadModelFromString(source), numLevels);
+	WriteCache(mesh, cacheDirectory, path, hash);
+	Log(LogLevel::Info, "mesh cache: %s processed in %.2f ms and stored in %s", filepath,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), path.c_str());
+}
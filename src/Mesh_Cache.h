@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Mesh_Lod.h"
+
+namespace Core
+{
+	// Loads an .obj model together with numLevels levels of detail. The processed mesh is kept in
+	// a binary file in cacheDirectory, named after a hash of the .obj contents and the processing
+	// settings, so later runs skip parsing and simplification until the model changes.
+	void LoadLodMesh(LodMesh & mesh, const char * filepath, int numLevels, const char * cacheDirectory = "mesh_cache");
+}
@@ -0,0 +1,388 @@
+#include "Mesh_Lod.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+
+#include "Logger.h"
+#include "Mesh_Optimizer.h"
+
+namespace
+{
+	// smallest share of half the screen height covered by the mesh for each level
+	const float lodScreenRadius[Core::LodMesh::maxLevels] = { 0.0f, 0.12f, 0.05f, 0.02f };
+	// share of the original triangles kept in each level
+	const float lodTriangleRatio[Core::LodMesh::maxLevels] = { 1.0f, 0.4f, 0.15f, 0.05f };
+	// largest error allowed in each level, as a share of the bounding radius
+	const float lodErrorLimit[Core::LodMesh::maxLevels] = { 0.0f, 0.03f, 0.1f, 0.3f };
+
+	const std::vector<unsigned short> & Triangles(const obj::Model & model)
+	{
+		static const std::vector<unsigned short> none;
+		auto faces = model.faces.find("default");
+		return faces != model.faces.end() ? faces->second : none;
+	}
+
+	// copies the given triangles and the vertices they use into a new model
+	obj::Model ExtractTriangles(const obj::Model & model, const std::vector<unsigned short> & triangles)
+	{
+		obj::Model result;
+		std::vector<int> remap(model.vertex.size() / 3, -1);
+		std::vector<unsigned short> & faces = result.faces["default"];
+		for (unsigned short index : triangles)
+		{
+			if (remap[index] < 0)
+			{
+				remap[index] = (int)(result.vertex.size() / 3);
+				result.vertex.insert(result.vertex.end(), model.vertex.begin() + 3 * index, model.vertex.begin() + 3 * index + 3);
+				if (!model.texCoord.empty())
+					result.texCoord.insert(result.texCoord.end(), model.texCoord.begin() + 2 * index, model.texCoord.begin() + 2 * index + 2);
+				if (!model.normal.empty())
+					result.normal.insert(result.normal.end(), model.normal.begin() + 3 * index, model.normal.begin() + 3 * index + 3);
+			}
+			faces.push_back((unsigned short)remap[index]);
+		}
+		return result;
+	}
+
+	// symmetric 4x4 error quadric of Garland & Heckbert (a00 a01 a02 a03 a11 a12 a13 a22 a23 a33)
+	struct Quadric
+	{
+		double a[10];
+
+		Quadric() { std::fill(a, a + 10, 0.0); }
+
+		void AddPlane(const glm::dvec3 & n, double d)
+		{
+			a[0] += n.x * n.x; a[1] += n.x * n.y; a[2] += n.x * n.z; a[3] += n.x * d;
+			a[4] += n.y * n.y; a[5] += n.y * n.z; a[6] += n.y * d;
+			a[7] += n.z * n.z; a[8] += n.z * d;
+			a[9] += d * d;
+		}
+
+		Quadric & operator+=(const Quadric & other)
+		{
+			for (int i = 0; i < 10; i++) a[i] += other.a[i];
+			return *this;
+		}
+
+		// sum of the squared distances of p to the planes of the quadric
+		double Evaluate(const glm::dvec3 & p) const
+		{
+			return a[0] * p.x * p.x + 2 * a[1] * p.x * p.y + 2 * a[2] * p.x * p.z + 2 * a[3] * p.x
+				+ a[4] * p.y * p.y + 2 * a[5] * p.y * p.z + 2 * a[6] * p.y
+				+ a[7] * p.z * p.z + 2 * a[8] * p.z + a[9];
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		int from, to;
+
+		bool operator>(const Collapse & other) const { return cost > other.cost; }
+	};
+
+	// closest point to p on the triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+	glm::dvec3 ClosestPointOnTriangle(const glm::dvec3 & p, const glm::dvec3 & a, const glm::dvec3 & b, const glm::dvec3 & c)
+	{
+		glm::dvec3 ab = b - a, ac = c - a, ap = p - a;
+		double d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0.0 && d2 <= 0.0) return a;
+		glm::dvec3 bp = p - b;
+		double d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0.0 && d4 <= d3) return b;
+		double vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) return a + ab * (d1 / (d1 - d3));
+		glm::dvec3 cp = p - c;
+		double d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0.0 && d5 <= d6) return c;
+		double vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) return a + ac * (d2 / (d2 - d6));
+		double va = d3 * d6 - d5 * d4;
+		if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		double denominator = 1.0 / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	// largest distance from a vertex of the original to the simplified surface
+	double MeasureError(const std::vector<glm::dvec3> & positions, const std::vector<int> & triangles)
+	{
+		double maxDistance2 = 0.0;
+		for (const glm::dvec3 & p : positions)
+		{
+			double distance2 = std::numeric_limits<double>::max();
+			for (size_t t = 0; t + 2 < triangles.size() && distance2 > maxDistance2; t += 3)
+			{
+				glm::dvec3 d = p - ClosestPointOnTriangle(p, positions[triangles[t]], positions[triangles[t + 1]], positions[triangles[t + 2]]);
+				distance2 = std::min(distance2, glm::dot(d, d));
+			}
+			maxDistance2 = std::max(maxDistance2, distance2);
+		}
+		return sqrt(maxDistance2);
+	}
+
+	// Quadric error decimation by half-edge collapses (a vertex is merged into a neighbour, so the kept
+	// vertices keep their texture coordinates and normals) until at most targetTriangles are left or the
+	// next collapse would move the surface by more than maxError. Vertices on attribute seams and on
+	// open borders are never moved, so the mesh doesn't tear. error receives the largest distance of
+	// the result from the original vertices, in model units.
+	obj::Model Decimate(const obj::Model & model, int targetTriangles, double maxError, float & error)
+	{
+		int numVertices = (int)(model.vertex.size() / 3);
+		std::vector<glm::dvec3> positions(numVertices);
+		for (int i = 0; i < numVertices; i++)
+			positions[i] = glm::dvec3(model.vertex[3 * i], model.vertex[3 * i + 1], model.vertex[3 * i + 2]);
+		const std::vector<unsigned short> & source = Triangles(model);
+		std::vector<int> indices(source.begin(), source.end());
+		int numTriangles = (int)(indices.size() / 3);
+
+		// vertices at the same position (split by texture coordinates or normals) share a group
+		std::vector<int> order(numVertices), group(numVertices);
+		for (int i = 0; i < numVertices; i++) order[i] = i;
+		auto samePosition = [&](int a, int b) { return positions[a] == positions[b]; };
+		std::sort(order.begin(), order.end(), [&](int a, int b) {
+			const glm::dvec3 & p = positions[a], & q = positions[b];
+			return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+		});
+		std::vector<int> groupSizes;
+		for (int i = 0; i < numVertices; i++)
+		{
+			if (i == 0 || !samePosition(order[i - 1], order[i])) groupSizes.push_back(0);
+			group[order[i]] = (int)groupSizes.size() - 1;
+			groupSizes.back()++;
+		}
+
+		std::vector<char> locked(numVertices, 0), lockedGroups(groupSizes.size(), 0);
+		std::map<std::pair<int, int>, int> edgeUses;
+		for (int t = 0; t < numTriangles; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				int a = group[indices[3 * t + k]], b = group[indices[3 * t + (k + 1) % 3]];
+				edgeUses[std::make_pair(std::min(a, b), std::max(a, b))]++;
+			}
+		}
+		for (auto & edge : edgeUses)
+		{
+			if (edge.second == 1)
+				lockedGroups[edge.first.first] = lockedGroups[edge.first.second] = 1;
+		}
+		for (int i = 0; i < numVertices; i++)
+			locked[i] = groupSizes[group[i]] > 1 || lockedGroups[group[i]];
+
+		// the planes of all triangles around a position
+		std::vector<Quadric> groupQuadrics(groupSizes.size());
+		std::vector<std::vector<int> > vertexTriangles(numVertices);
+		for (int t = 0; t < numTriangles; t++)
+		{
+			const int * v = &indices[3 * t];
+			glm::dvec3 n = glm::cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+			double length = glm::length(n);
+			for (int k = 0; k < 3; k++)
+			{
+				if (length > 0.0) groupQuadrics[group[v[k]]].AddPlane(n / length, -glm::dot(n / length, positions[v[0]]));
+				vertexTriangles[v[k]].push_back(t);
+			}
+		}
+		std::vector<Quadric> quadrics(numVertices);
+		for (int i = 0; i < numVertices; i++)
+			quadrics[i] = groupQuadrics[group[i]];
+
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > queue;
+		auto consider = [&](int from, int to) {
+			if (from != to && !locked[from])
+				queue.push({ quadrics[from].Evaluate(positions[to]), from, to });
+		};
+		for (int t = 0; t < numTriangles; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				consider(indices[3 * t + k], indices[3 * t + (k + 1) % 3]);
+				consider(indices[3 * t + (k + 1) % 3], indices[3 * t + k]);
+			}
+		}
+
+		std::vector<char> deadTriangles(numTriangles, 0), removed(numVertices, 0);
+		auto contains = [&](int t, int v) { return indices[3 * t] == v || indices[3 * t + 1] == v || indices[3 * t + 2] == v; };
+		int aliveTriangles = numTriangles;
+		while (aliveTriangles > targetTriangles && !queue.empty())
+		{
+			Collapse collapse = queue.top();
+			// the quadric sums the squared distances to all merged planes, so this limit is conservative
+			if (collapse.cost > maxError * maxError) break;
+			queue.pop();
+			int from = collapse.from, to = collapse.to;
+			if (removed[from] || removed[to]) continue;
+
+			// quadrics only grow, so an outdated entry goes back with its current cost
+			double cost = quadrics[from].Evaluate(positions[to]);
+			if (cost > collapse.cost * (1.0 + 1e-9) + 1e-15)
+			{
+				queue.push({ cost, from, to });
+				continue;
+			}
+
+			bool adjacent = false, flips = false;
+			for (int t : vertexTriangles[from])
+			{
+				if (deadTriangles[t]) continue;
+				if (contains(t, to))
+				{
+					adjacent = true;
+					continue;
+				}
+				// the triangles that stay must not turn over
+				const int * v = &indices[3 * t];
+				glm::dvec3 p[3], q[3];
+				for (int k = 0; k < 3; k++)
+				{
+					p[k] = positions[v[k]];
+					q[k] = v[k] == from ? positions[to] : p[k];
+				}
+				glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]), after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				if (glm::dot(before, after) <= 0.2 * glm::length(before) * glm::length(after))
+					flips = true;
+			}
+			if (!adjacent || flips) continue;
+
+			for (int t : vertexTriangles[from])
+			{
+				if (deadTriangles[t]) continue;
+				if (contains(t, to))
+				{
+					deadTriangles[t] = 1;
+					aliveTriangles--;
+					continue;
+				}
+				for (int k = 0; k < 3; k++)
+				{
+					if (indices[3 * t + k] == from) indices[3 * t + k] = to;
+				}
+				vertexTriangles[to].push_back(t);
+			}
+			removed[from] = 1;
+			quadrics[to] += quadrics[from];
+
+			for (int t : vertexTriangles[to])
+			{
+				if (deadTriangles[t]) continue;
+				for (int k = 0; k < 3; k++)
+				{
+					consider(to, indices[3 * t + k]);
+					consider(indices[3 * t + k], to);
+				}
+			}
+		}
+
+		std::vector<int> alive;
+		for (int t = 0; t < numTriangles; t++)
+		{
+			if (deadTriangles[t]) continue;
+			alive.insert(alive.end(), indices.begin() + 3 * t, indices.begin() + 3 * t + 3);
+		}
+		error = (float)MeasureError(positions, alive);
+		return ExtractTriangles(model, std::vector<unsigned short>(alive.begin(), alive.end()));
+	}
+}
+
+void Core::BuildLodMesh(LodMesh & mesh, const obj::Model & model, int numLevels)
+{
+	mesh.bounds = ComputeBounds(model);
+	mesh.numLevels = std::max(1, std::min(numLevels, (int)LodMesh::maxLevels));
+	obj::Model levels[LodMesh::maxLevels];
+	levels[0] = model;
+	mesh.errors[0] = 0.0f;
+	for (int level = 1; level < mesh.numLevels; level++)
+	{
+		int target = (int)(GetTriangleCount(model) * lodTriangleRatio[level]);
+		levels[level] = Decimate(model, target, lodErrorLimit[level] * mesh.bounds.radius, mesh.errors[level]);
+	}
+	for (int level = 0; level < mesh.numLevels; level++)
+	{
+		mesh.acmrBefore[level] = ComputeAcmr(levels[level]);
+		OptimizeModel(levels[level]);
+		mesh.acmrAfter[level] = ComputeAcmr(levels[level]);
+		mesh.levels[level] = PackModel(levels[level]);
+	}
+}
+
+void Core::UploadLodMesh(LodMesh & mesh)
+{
+	for (int level = 0; level < mesh.numLevels; level++)
+		UploadPackedModel(mesh.levels[level]);
+}
+
+void Core::ReportLodMesh(const LodMesh & mesh, const char * name, int screenHeight)
+{
+	int triangles = GetTriangleCount(mesh.levels[0]);
+	Log(LogLevel::Info, "%s: %d triangles, radius %.3f, ACMR %.3f -> %.3f", name, triangles, mesh.bounds.radius, mesh.acmrBefore[0], mesh.acmrAfter[0]);
+	size_t vertices = 0;
+	for (int level = 0; level < mesh.numLevels; level++)
+		vertices += mesh.levels[level].vertices.size();
+	Log(LogLevel::Info, "%s: %d vertices in %d levels, %.1f KB packed instead of %.1f KB as floats", name, (int)vertices, mesh.numLevels,
+		vertices * sizeof(PackedVertex) / 1024.0f, vertices * 8 * sizeof(float) / 1024.0f);
+	for (int level = 1; level < mesh.numLevels; level++)
+	{
+		int levelTriangles = GetTriangleCount(mesh.levels[level]);
+		// the error as it appears when the level is switched in (the mesh covers lodScreenRadius of half the screen)
+		float pixels = mesh.errors[level] / mesh.bounds.radius * lodScreenRadius[level] * screenHeight * 0.5f;
+		Log(LogLevel::Info, "%s LOD %d: %d triangles (-%.0f%%), error %.4f (%.2f px on a %d px high screen), ACMR %.3f -> %.3f",
+			name, level, levelTriangles, 100.0f * (triangles - levelTriangles) / std::max(triangles, 1), mesh.errors[level], pixels, screenHeight,
+			mesh.acmrBefore[level], mesh.acmrAfter[level]);
+	}
+}
+
+int Core::SelectLod(const LodMesh & mesh, float screenRadius)
+{
+	int level = 0;
+	for (int l = 1; l < mesh.numLevels; l++)
+	{
+		if (screenRadius < lodScreenRadius[l])
+			level = l;
+	}
+	return level;
+}
+
+std::vector<obj::Model> Core::SplitModel(const obj::Model & model, int chunksPerAxis)
+{
+	Bounds bounds = ComputeBounds(model);
+	glm::vec3 extent = bounds.max - bounds.min;
+
+	// the two longest axes of the mesh
+	int axes[3] = { 0, 1, 2 };
+	std::sort(axes, axes + 3, [&](int a, int b) { return extent[a] > extent[b]; });
+	int u = axes[0], v = axes[1];
+
+	const std::vector<unsigned short> & triangles = Triangles(model);
+	std::vector<std::vector<unsigned short> > chunks(chunksPerAxis * chunksPerAxis);
+	for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+	{
+		glm::vec3 centroid(0.0f);
+		for (int k = 0; k < 3; k++)
+			centroid += glm::vec3(model.vertex[3 * triangles[t + k]], model.vertex[3 * triangles[t + k] + 1], model.vertex[3 * triangles[t + k] + 2]) / 3.0f;
+		int cu = std::min(chunksPerAxis - 1, (int)((centroid[u] - bounds.min[u]) / std::max(extent[u], 1e-6f) * chunksPerAxis));
+		int cv = std::min(chunksPerAxis - 1, (int)((centroid[v] - bounds.min[v]) / std::max(extent[v], 1e-6f) * chunksPerAxis));
+		chunks[cu + chunksPerAxis * cv].insert(chunks[cu + chunksPerAxis * cv].end(), triangles.begin() + t, triangles.begin() + t + 3);
+	}
+
+	std::vector<obj::Model> result;
+	for (auto & chunk : chunks)
+	{
+		if (!chunk.empty())
+			result.push_back(ExtractTriangles(model, chunk));
+	}
+	return result;
+}
+
+int Core::GetTriangleCount(const obj::Model & model)
+{
+	return (int)(Triangles(model).size() / 3);
+}
+
+int Core::GetTriangleCount(const PackedModel & model)
+{
+	return (int)(model.indices.size() / 3);
+}
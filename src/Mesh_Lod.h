@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "objload.h"
+#include "Culling.h"
+#include "Packed_Mesh.h"
+
+namespace Core
+{
+	// A mesh with its levels of detail, levels[0] is the original and every next one is coarser.
+	struct LodMesh
+	{
+		static const int maxLevels = 4;
+		PackedModel levels[maxLevels];
+		// largest distance of each level from the original surface, in model units
+		float errors[maxLevels];
+		// vertex cache miss ratio of each level before and after OptimizeModel()
+		float acmrBefore[maxLevels], acmrAfter[maxLevels];
+		int numLevels;
+		Bounds bounds;
+	};
+
+	// Builds numLevels levels of detail of the model, the coarser ones by quadric error decimation
+	// to 40%, 15% and 5% of the triangles. Every level is reordered for the vertex cache and packed.
+	void BuildLodMesh(LodMesh & mesh, const obj::Model & model, int numLevels);
+
+	// Creates the GPU buffers of every level, needs the GL context.
+	void UploadLodMesh(LodMesh & mesh);
+
+	// Logs the triangle reduction and the error of each level, also in pixels at the size
+	// the level gets selected for on a screen screenHeight pixels high, and the vertex cache miss ratios.
+	void ReportLodMesh(const LodMesh & mesh, const char * name, int screenHeight);
+
+	// Picks the level for a mesh whose bounding sphere covers screenRadius of half the screen height.
+	int SelectLod(const LodMesh & mesh, float screenRadius);
+
+	// Splits a large mesh into chunks on a chunksPerAxis x chunksPerAxis grid spanning its two
+	// longest axes, so the parts out of view can be culled separately. Empty chunks are skipped.
+	std::vector<obj::Model> SplitModel(const obj::Model & model, int chunksPerAxis);
+
+	int GetTriangleCount(const obj::Model & model);
+	int GetTriangleCount(const PackedModel & model);
+}
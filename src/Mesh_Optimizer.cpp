@@ -0,0 +1,189 @@
+#include "Mesh_Optimizer.h"
+
+#include <algorithm>
+
+#include "glm.hpp"
+
+namespace
+{
+	// smallest cluster worth sorting on its own, smaller ones stay glued to the previous cluster
+	const int minClusterTriangles = 32;
+
+	std::vector<unsigned short> & Triangles(obj::Model & model)
+	{
+		return model.faces["default"];
+	}
+
+	glm::vec3 Position(const obj::Model & model, int index)
+	{
+		return glm::vec3(model.vertex[3 * index], model.vertex[3 * index + 1], model.vertex[3 * index + 2]);
+	}
+
+	// Tipsify: fans out around the current vertex and picks the next one among the vertices just
+	// emitted that will still be in the cache. Returns the new triangle order, and the positions in it
+	// where the walk had to jump (cache contents lost) in clusterStarts.
+	std::vector<int> Tipsify(const std::vector<unsigned short> & indices, int numVertices, int cacheSize, std::vector<int> & clusterStarts)
+	{
+		int numTriangles = (int)(indices.size() / 3);
+
+		// triangles around each vertex
+		std::vector<int> offsets(numVertices + 1, 0), live(numVertices, 0);
+		for (unsigned short v : indices) live[v]++;
+		for (int v = 0; v < numVertices; v++) offsets[v + 1] = offsets[v] + live[v];
+		std::vector<int> adjacency(indices.size()), fill(offsets.begin(), offsets.end() - 1);
+		for (int t = 0; t < numTriangles; t++)
+		{
+			for (int k = 0; k < 3; k++)
+				adjacency[fill[indices[3 * t + k]]++] = t;
+		}
+
+		std::vector<int> order, timestamps(numVertices, 0), deadEnd, candidates;
+		std::vector<char> emitted(numTriangles, 0);
+		order.reserve(numTriangles);
+		int time = cacheSize + 1, cursor = 0;
+		int current = numVertices > 0 ? 0 : -1;
+		clusterStarts.assign(1, 0);
+
+		while (current >= 0)
+		{
+			candidates.clear();
+			for (int a = offsets[current]; a < offsets[current + 1]; a++)
+			{
+				int t = adjacency[a];
+				if (emitted[t]) continue;
+				for (int k = 0; k < 3; k++)
+				{
+					int v = indices[3 * t + k];
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - timestamps[v] > cacheSize)
+						timestamps[v] = time++;
+				}
+				emitted[t] = 1;
+				order.push_back(t);
+			}
+
+			// the candidate that stays in the cache longest while all its triangles get emitted
+			int next = -1, best = -1;
+			for (int v : candidates)
+			{
+				if (live[v] <= 0) continue;
+				int priority = 0;
+				if (time - timestamps[v] + 2 * live[v] <= cacheSize)
+					priority = time - timestamps[v];
+				if (priority > best)
+				{
+					best = priority;
+					next = v;
+				}
+			}
+			if (next < 0)
+			{
+				// dead end: go back to a recently used vertex, or else to any vertex with triangles left
+				while (!deadEnd.empty() && next < 0)
+				{
+					int v = deadEnd.back();
+					deadEnd.pop_back();
+					if (live[v] > 0) next = v;
+				}
+				while (next < 0 && cursor < numVertices)
+				{
+					if (live[cursor] > 0) next = cursor;
+					cursor++;
+				}
+				if (next >= 0 && (int)order.size() - clusterStarts.back() >= minClusterTriangles)
+					clusterStarts.push_back((int)order.size());
+			}
+			current = next;
+		}
+		return order;
+	}
+}
+
+float Core::ComputeAcmr(const obj::Model & model, int cacheSize)
+{
+	auto faces = model.faces.find("default");
+	if (faces == model.faces.end() || faces->second.empty()) return 0.0f;
+	const std::vector<unsigned short> & indices = faces->second;
+
+	std::vector<int> cache;
+	int misses = 0;
+	for (unsigned short v : indices)
+	{
+		if (std::find(cache.begin(), cache.end(), v) != cache.end()) continue;
+		misses++;
+		cache.push_back(v);
+		if ((int)cache.size() > cacheSize) cache.erase(cache.begin());
+	}
+	return misses / (indices.size() / 3.0f);
+}
+
+void Core::OptimizeModel(obj::Model & model, int cacheSize)
+{
+	std::vector<unsigned short> & indices = Triangles(model);
+	int numVertices = (int)(model.vertex.size() / 3);
+	if (indices.empty() || numVertices == 0) return;
+
+	std::vector<int> clusterStarts;
+	std::vector<int> order = Tipsify(indices, numVertices, cacheSize, clusterStarts);
+	clusterStarts.push_back((int)order.size());
+
+	// clusters facing away from the middle of the mesh go first, they cover the ones behind them
+	glm::vec3 meshCenter(0.0f);
+	for (int v = 0; v < numVertices; v++) meshCenter += Position(model, v) / (float)numVertices;
+	int numClusters = (int)clusterStarts.size() - 1;
+	std::vector<float> outwardness(numClusters);
+	for (int c = 0; c < numClusters; c++)
+	{
+		// area weighted centroid and normal of the cluster
+		glm::vec3 center(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (int i = clusterStarts[c]; i < clusterStarts[c + 1]; i++)
+		{
+			const unsigned short * v = &indices[3 * order[i]];
+			glm::vec3 p0 = Position(model, v[0]), p1 = Position(model, v[1]), p2 = Position(model, v[2]);
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			center += (p0 + p1 + p2) * glm::length(n);
+			area += glm::length(n);
+			normal += n;
+		}
+		if (area > 0.0f) center /= 3.0f * area;
+		float length = glm::length(normal);
+		outwardness[c] = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+	}
+	std::vector<int> clusters(numClusters);
+	for (int c = 0; c < numClusters; c++) clusters[c] = c;
+	std::stable_sort(clusters.begin(), clusters.end(), [&](int a, int b) { return outwardness[a] > outwardness[b]; });
+
+	std::vector<unsigned short> reordered;
+	reordered.reserve(indices.size());
+	for (int c : clusters)
+	{
+		for (int i = clusterStarts[c]; i < clusterStarts[c + 1]; i++)
+			reordered.insert(reordered.end(), indices.begin() + 3 * order[i], indices.begin() + 3 * order[i] + 3);
+	}
+
+	// vertices in the order the index buffer first touches them
+	std::vector<int> remap(numVertices, -1);
+	int used = 0;
+	for (unsigned short & v : reordered)
+	{
+		if (remap[v] < 0) remap[v] = used++;
+		v = (unsigned short)remap[v];
+	}
+	obj::Model result;
+	result.vertex.resize(used * 3);
+	if (!model.texCoord.empty()) result.texCoord.resize(used * 2);
+	if (!model.normal.empty()) result.normal.resize(used * 3);
+	for (int v = 0; v < numVertices; v++)
+	{
+		int r = remap[v];
+		if (r < 0) continue;
+		std::copy(model.vertex.begin() + 3 * v, model.vertex.begin() + 3 * v + 3, result.vertex.begin() + 3 * r);
+		if (!model.texCoord.empty()) std::copy(model.texCoord.begin() + 2 * v, model.texCoord.begin() + 2 * v + 2, result.texCoord.begin() + 2 * r);
+		if (!model.normal.empty()) std::copy(model.normal.begin() + 3 * v, model.normal.begin() + 3 * v + 3, result.normal.begin() + 3 * r);
+	}
+	result.faces["default"].swap(reordered);
+	model = result;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "objload.h"
+
+namespace Core
+{
+	// Average cache miss ratio: vertices transformed per triangle with a FIFO post-transform cache
+	// of cacheSize entries. 3 is the worst case, around 0.6 - 0.7 is good for a closed mesh.
+	float ComputeAcmr(const obj::Model & model, int cacheSize = 16);
+
+	// Reorders the mesh for the GPU without changing what is drawn:
+	// - triangles for post-transform cache hits (Tipsify, Sander et al. 2007),
+	// - the resulting clusters so the outward facing ones are drawn first (less overdraw),
+	// - vertices in the order of their first use (vertex fetch locality).
+	void OptimizeModel(obj::Model & model, int cacheSize = 16);
+}
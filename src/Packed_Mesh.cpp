@@ -0,0 +1,160 @@
+#include "Packed_Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace
+{
+	short PackSnorm(float value)
+	{
+		return (short)std::lround(std::max(-1.0f, std::min(1.0f, value)) * 32767.0f);
+	}
+
+	unsigned short PackUnorm(float value)
+	{
+		return (unsigned short)std::lround(std::max(0.0f, std::min(1.0f, value)) * 65535.0f);
+	}
+
+	float UnpackSnorm(short value)
+	{
+		return std::max(value / 32767.0f, -1.0f);
+	}
+
+	float SignNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	// Cigolle et al., A Survey of Efficient Representations for Independent Unit Vectors
+	glm::vec2 OctahedronEncode(glm::vec3 n)
+	{
+		n /= std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		glm::vec2 e(n.x, n.y);
+		if (n.z < 0.0f)
+			e = glm::vec2((1.0f - std::fabs(n.y)) * SignNotZero(n.x), (1.0f - std::fabs(n.x)) * SignNotZero(n.y));
+		return e;
+	}
+
+	glm::vec3 OctahedronDecode(glm::vec2 e)
+	{
+		glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+		if (n.z < 0.0f)
+			n = glm::vec3((1.0f - std::fabs(e.y)) * SignNotZero(e.x), (1.0f - std::fabs(e.x)) * SignNotZero(e.y), n.z);
+		return glm::normalize(n);
+	}
+}
+
+Core::PackedModel Core::PackModel(const obj::Model & model)
+{
+	PackedModel packed;
+	int numVertices = (int)(model.vertex.size() / 3);
+	bool hasTexCoords = model.texCoord.size() >= (size_t)numVertices * 2;
+	bool hasNormals = model.normal.size() >= (size_t)numVertices * 3;
+
+	// ranges of the positions and texture coordinates
+	glm::vec3 minPosition(0.0f), maxPosition(0.0f);
+	glm::vec2 minTexCoord(0.0f), maxTexCoord(0.0f);
+	for (int i = 0; i < numVertices; i++)
+	{
+		glm::vec3 p(model.vertex[3 * i], model.vertex[3 * i + 1], model.vertex[3 * i + 2]);
+		minPosition = i == 0 ? p : glm::min(minPosition, p);
+		maxPosition = i == 0 ? p : glm::max(maxPosition, p);
+		if (hasTexCoords)
+		{
+			glm::vec2 t(model.texCoord[2 * i], model.texCoord[2 * i + 1]);
+			minTexCoord = i == 0 ? t : glm::min(minTexCoord, t);
+			maxTexCoord = i == 0 ? t : glm::max(maxTexCoord, t);
+		}
+	}
+	packed.positionOffset = (minPosition + maxPosition) * 0.5f;
+	packed.positionScale = glm::max((maxPosition - minPosition) * 0.5f, glm::vec3(1e-6f));
+	packed.texCoordOffset = minTexCoord;
+	packed.texCoordScale = glm::max(maxTexCoord - minTexCoord, glm::vec2(1e-6f));
+
+	packed.vertices.resize(numVertices);
+	for (int i = 0; i < numVertices; i++)
+	{
+		PackedVertex & v = packed.vertices[i];
+		for (int k = 0; k < 3; k++)
+			v.position[k] = PackSnorm((model.vertex[3 * i + k] - packed.positionOffset[k]) / packed.positionScale[k]);
+		v.position[3] = 0;
+
+		glm::vec3 n = hasNormals ? glm::vec3(model.normal[3 * i], model.normal[3 * i + 1], model.normal[3 * i + 2]) : glm::vec3(0.0f, 0.0f, 1.0f);
+		glm::vec2 e = OctahedronEncode(glm::length(n) > 0.0f ? n : glm::vec3(0.0f, 0.0f, 1.0f));
+		v.normal[0] = PackSnorm(e.x);
+		v.normal[1] = PackSnorm(e.y);
+
+		for (int k = 0; k < 2; k++)
+			v.texCoord[k] = hasTexCoords ? PackUnorm((model.texCoord[2 * i + k] - packed.texCoordOffset[k]) / packed.texCoordScale[k]) : 0;
+	}
+
+	auto faces = model.faces.find("default");
+	if (faces != model.faces.end())
+		packed.indices = faces->second;
+	return packed;
+}
+
+obj::Model Core::UnpackModel(const PackedModel & model)
+{
+	obj::Model result;
+	for (const PackedVertex & v : model.vertices)
+	{
+		for (int k = 0; k < 3; k++)
+			result.vertex.push_back(model.positionOffset[k] + model.positionScale[k] * UnpackSnorm(v.position[k]));
+		for (int k = 0; k < 2; k++)
+			result.texCoord.push_back(model.texCoordOffset[k] + model.texCoordScale[k] * (v.texCoord[k] / 65535.0f));
+		glm::vec3 n = OctahedronDecode(glm::vec2(UnpackSnorm(v.normal[0]), UnpackSnorm(v.normal[1])));
+		result.normal.insert(result.normal.end(), { n.x, n.y, n.z });
+	}
+	result.faces["default"] = model.indices;
+	return result;
+}
+
+void Core::UploadPackedModel(PackedModel & model)
+{
+	if (model.vertexArray || model.vertices.empty()) return;
+
+	glGenVertexArrays(1, &model.vertexArray);
+	glBindVertexArray(model.vertexArray);
+
+	glGenBuffers(1, &model.vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, model.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, model.vertices.size() * sizeof(PackedVertex), &model.vertices[0], GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (const void *)offsetof(PackedVertex, position));
+	glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (const void *)offsetof(PackedVertex, texCoord));
+	glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (const void *)offsetof(PackedVertex, normal));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+
+	glGenBuffers(1, &model.indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, model.indices.size() * sizeof(unsigned short), model.indices.data(), GL_STATIC_DRAW);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+Core::PackedModelUniforms Core::GetPackedModelUniforms(GLuint program)
+{
+	PackedModelUniforms uniforms;
+	uniforms.positionOffset = glGetUniformLocation(program, "positionOffset");
+	uniforms.positionScale = glGetUniformLocation(program, "positionScale");
+	uniforms.texCoordOffset = glGetUniformLocation(program, "texCoordOffset");
+	uniforms.texCoordScale = glGetUniformLocation(program, "texCoordScale");
+	return uniforms;
+}
+
+void Core::DrawPackedModel(const PackedModel & model, const PackedModelUniforms & uniforms)
+{
+	glUniform3fv(uniforms.positionOffset, 1, &model.positionOffset[0]);
+	glUniform3fv(uniforms.positionScale, 1, &model.positionScale[0]);
+	glUniform2fv(uniforms.texCoordOffset, 1, &model.texCoordOffset[0]);
+	glUniform2fv(uniforms.texCoordScale, 1, &model.texCoordScale[0]);
+
+	glBindVertexArray(model.vertexArray);
+	glDrawElements(GL_TRIANGLES, (GLsizei)model.indices.size(), GL_UNSIGNED_SHORT, 0);
+	glBindVertexArray(0);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include "glew.h"
+#include "glm.hpp"
+#include "objload.h"
+
+namespace Core
+{
+	// Interleaved GPU vertex, 16 bytes instead of the 32 of three float arrays:
+	// - position as normalized int16 inside the box of the mesh (positionOffset + positionScale * p),
+	// - normal encoded on an octahedron in two normalized int16,
+	// - texture coordinates as unorm16 inside the UV range of the mesh (texCoordOffset + texCoordScale * t).
+	struct PackedVertex
+	{
+		short position[4];
+		short normal[2];
+		unsigned short texCoord[2];
+	};
+
+	struct PackedModel
+	{
+		std::vector<PackedVertex> vertices;
+		std::vector<unsigned short> indices;
+		glm::vec3 positionOffset, positionScale;
+		glm::vec2 texCoordOffset, texCoordScale;
+
+		// buffers on the GPU, created by UploadPackedModel()
+		GLuint vertexArray = 0, vertexBuffer = 0, indexBuffer = 0;
+	};
+
+	// Locations of the uniforms that decode the packed vertices in a program (see shaders/*.vert).
+	struct PackedModelUniforms
+	{
+		GLint positionOffset, positionScale, texCoordOffset, texCoordScale;
+	};
+
+	PackedModel PackModel(const obj::Model & model);
+
+	// Float copy of a packed model, e.g. for collision shapes or further processing.
+	obj::Model UnpackModel(const PackedModel & model);
+
+	// Creates the vertex array with the vertex and index buffers of the model.
+	void UploadPackedModel(PackedModel & model);
+
+	PackedModelUniforms GetPackedModelUniforms(GLuint program);
+
+	// Sets the decode uniforms of the current program and draws the uploaded model.
+	void DrawPackedModel(const PackedModel & model, const PackedModelUniforms & uniforms);
+}
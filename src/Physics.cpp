@@ -5,10 +5,14 @@
 Physics::Physics(float gravity)
 {
     foundation = PxCreateFoundation(PX_PHYSICS_VERSION, allocator, errorCallback);
+    // type names for the allocation statistics
+    foundation->setReportAllocationNames(true);
 
     cooking = PxCreateCooking(PX_PHYSICS_VERSION, *foundation, PxCookingParams(PxTolerancesScale()));
 
     physics = PxCreatePhysics(PX_PHYSICS_VERSION, *foundation, PxTolerancesScale(), true);
+    physics->registerDeletionListener(auditor, PxDeletionEventFlag::eMEMORY_RELEASE);
+    serializationRegistry = PxSerialization::createSerializationRegistry(*physics);
 
     PxSceneDesc sceneDesc(physics->getTolerancesScale());
     sceneDesc.gravity = PxVec3(0.0f, -gravity, 0.0f);
@@ -22,7 +26,10 @@ Physics::~Physics()
 {
     PX_RELEASE(scene);
     PX_RELEASE(dispatcher);
+    PX_RELEASE(serializationRegistry);
+    if (physics) physics->unregisterDeletionListener(auditor);
     PX_RELEASE(physics);
+    PX_RELEASE(cooking);
     PX_RELEASE(foundation);
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "PxPhysicsAPI.h"
+#include "Physics_Allocator.h"
+#include "Physics_Auditor.h"
 using namespace physx;
 
 class Physics
@@ -11,11 +13,19 @@ public:
     PxCooking* cooking;
     PxPhysics*              physics = nullptr;
     PxScene*				scene = nullptr;
+    // every PhysX allocation goes through the pools of allocator,
+    // rackArena holds the transient buffers of the current rack (reset by its owner)
+    PhysicsAllocator        allocator;
+    PhysicsArena            rackArena;
+    // holds the objects created from snapshots that live as long as the scene
+    PhysicsArena            sceneArena;
+    // live objects by category, the game tracks what it creates
+    PhysicsAuditor          auditor;
+    PxSerializationRegistry* serializationRegistry = nullptr;
 
     void step(float dt);
 
 private:
-    PxDefaultAllocator		allocator;
     PxDefaultErrorCallback	errorCallback;
     PxFoundation*			foundation = nullptr;
     PxDefaultCpuDispatcher*	dispatcher = nullptr;
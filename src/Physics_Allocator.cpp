@@ -0,0 +1,258 @@
+#include "Physics_Allocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "Logger.h"
+
+namespace
+{
+    // every block starts with a header, the memory handed to PhysX follows it 16 byte aligned
+    struct BlockHeader
+    {
+        int sizeClass;  // -1 for blocks not from the pools
+        int typeIndex;
+        size_t size;
+    };
+    const size_t headerSize = 16;
+    static_assert(sizeof(BlockHeader) <= headerSize, "block header has to fit before the aligned memory");
+
+    void* alignedAlloc(size_t size)
+    {
+#ifdef _WIN32
+        return _aligned_malloc(size, 16);
+#else
+        void* ptr = nullptr;
+        return posix_memalign(&ptr, 16, size) == 0 ? ptr : nullptr;
+#endif
+    }
+
+    void alignedFree(void* ptr)
+    {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+}
+
+PhysicsAllocator::PhysicsAllocator()
+{
+    std::fill(freeLists, freeLists + numSizeClasses, nullptr);
+}
+
+PhysicsAllocator::~PhysicsAllocator()
+{
+    for (void* page : pages) {
+        alignedFree(page);
+    }
+}
+
+void* PhysicsAllocator::allocatePooled(int sizeClass)
+{
+    if (!freeLists[sizeClass]) {
+        // carve a new page into blocks of this class
+        size_t blockSize = minBlockSize << sizeClass;
+        char* page = (char*)alignedAlloc(pageSize);
+        if (!page) return nullptr;
+        pages.push_back(page);
+        for (size_t offset = 0; offset + blockSize <= pageSize; offset += blockSize) {
+            FreeBlock* block = (FreeBlock*)(page + offset);
+            block->next = freeLists[sizeClass];
+            freeLists[sizeClass] = block;
+        }
+    }
+    FreeBlock* block = freeLists[sizeClass];
+    freeLists[sizeClass] = block->next;
+    return block;
+}
+
+int PhysicsAllocator::findType(const char* typeName)
+{
+    if (!typeName) typeName = "(unnamed)";
+    auto found = typeIndices.find(typeName);
+    if (found != typeIndices.end()) return found->second;
+    int index = (int)types.size();
+    types.push_back({ typeName, 0, 0, 0 });
+    typeIndices[typeName] = index;
+    return index;
+}
+
+void* PhysicsAllocator::allocate(size_t size, const char* typeName, const char* filename, int line)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    int sizeClass = -1;
+    char* block;
+    if (size <= maxPooledSize) {
+        sizeClass = 0;
+        while ((minBlockSize << sizeClass) < size + headerSize) sizeClass++;
+        block = (char*)allocatePooled(sizeClass);
+    }
+    else {
+        block = (char*)alignedAlloc(size + headerSize);
+    }
+    if (!block) {
+        Core::Log(Core::LogLevel::Error, "physics allocator: out of memory for %zu bytes of %s (%s:%d)", size, typeName ? typeName : "?", filename, line);
+        return nullptr;
+    }
+
+    BlockHeader* header = (BlockHeader*)block;
+    header->sizeClass = sizeClass;
+    header->typeIndex = findType(typeName);
+    header->size = size;
+
+    TypeStats& type = types[header->typeIndex];
+    type.liveBytes += size;
+    type.liveCount++;
+    type.totalCount++;
+    liveBytes += size;
+    liveCount++;
+    totalCount++;
+    peakBytes = std::max(peakBytes, liveBytes);
+    return block + headerSize;
+}
+
+void PhysicsAllocator::deallocate(void* ptr)
+{
+    if (!ptr) return;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    char* block = (char*)ptr - headerSize;
+    BlockHeader* header = (BlockHeader*)block;
+    TypeStats& type = types[header->typeIndex];
+    type.liveBytes -= header->size;
+    type.liveCount--;
+    liveBytes -= header->size;
+    liveCount--;
+
+    int sizeClass = header->sizeClass;
+    if (sizeClass < 0) {
+        alignedFree(block);
+        return;
+    }
+    // the free list link overwrites the header
+    FreeBlock* freeBlock = (FreeBlock*)block;
+    freeBlock->next = freeLists[sizeClass];
+    freeLists[sizeClass] = freeBlock;
+}
+
+size_t PhysicsAllocator::getLiveBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return liveBytes;
+}
+
+size_t PhysicsAllocator::getPeakBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return peakBytes;
+}
+
+size_t PhysicsAllocator::getLiveCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return liveCount;
+}
+
+size_t PhysicsAllocator::getTotalCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return totalCount;
+}
+
+size_t PhysicsAllocator::getPooledBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pages.size() * pageSize;
+}
+
+std::vector<PhysicsAllocator::TypeStats> PhysicsAllocator::getTypeStats() const
+{
+    std::vector<TypeStats> merged;
+    {
+        // the same name can come from string literals at different addresses
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<std::string, size_t> byName;
+        for (const TypeStats& type : types) {
+            auto found = byName.find(type.name);
+            if (found == byName.end()) {
+                byName[type.name] = merged.size();
+                merged.push_back(type);
+                continue;
+            }
+            TypeStats& sum = merged[found->second];
+            sum.liveBytes += type.liveBytes;
+            sum.liveCount += type.liveCount;
+            sum.totalCount += type.totalCount;
+        }
+    }
+    std::sort(merged.begin(), merged.end(), [](const TypeStats& a, const TypeStats& b) {
+        return a.liveBytes != b.liveBytes ? a.liveBytes > b.liveBytes : a.totalCount > b.totalCount;
+    });
+    return merged;
+}
+
+void PhysicsAllocator::report(const char* title, int maxTypes) const
+{
+    Core::Log(Core::LogLevel::Info, "%s: %.1f KB live in %zu blocks, %.1f KB peak, %zu allocations, %.1f KB pooled",
+        title, getLiveBytes() / 1024.0, getLiveCount(), getPeakBytes() / 1024.0, getTotalCount(), getPooledBytes() / 1024.0);
+    std::vector<TypeStats> stats = getTypeStats();
+    for (int i = 0; i < maxTypes && i < (int)stats.size(); i++) {
+        Core::Log(Core::LogLevel::Info, "%s:   %-48.48s %9.1f KB live in %6zu, %8zu allocations",
+            title, stats[i].name.c_str(), stats[i].liveBytes / 1024.0, stats[i].liveCount, stats[i].totalCount);
+    }
+}
+
+PhysicsArena::PhysicsArena(size_t blockSize) : blockSize(blockSize)
+{
+}
+
+PhysicsArena::~PhysicsArena()
+{
+    for (auto& block : blocks) {
+        alignedFree(block.first);
+    }
+}
+
+void* PhysicsArena::allocate(size_t size, const char* /*typeName*/, const char* filename, int line)
+{
+    size = (size + 15) & ~(size_t)15;
+    // the first block from the current one with enough room left
+    while (currentBlock < blocks.size()) {
+        if (offset + size <= blocks[currentBlock].second) break;
+        currentBlock++;
+        offset = 0;
+    }
+    if (currentBlock == blocks.size()) {
+        size_t newBlockSize = std::max(blockSize, size);
+        char* block = (char*)alignedAlloc(newBlockSize);
+        if (!block) {
+            Core::Log(Core::LogLevel::Error, "physics arena: out of memory for %zu bytes (%s:%d)", size, filename, line);
+            return nullptr;
+        }
+        blocks.push_back(std::make_pair(block, newBlockSize));
+    }
+    void* ptr = blocks[currentBlock].first + offset;
+    offset += size;
+    usedBytes += size;
+    peakBytes = std::max(peakBytes, usedBytes);
+    return ptr;
+}
+
+void PhysicsArena::reset()
+{
+    currentBlock = 0;
+    offset = 0;
+    usedBytes = 0;
+}
+
+size_t PhysicsArena::getReservedBytes() const
+{
+    size_t bytes = 0;
+    for (auto& block : blocks) {
+        bytes += block.second;
+    }
+    return bytes;
+}
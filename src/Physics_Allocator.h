@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "PxPhysicsAPI.h"
+using namespace physx;
+
+// Allocator for everything PhysX creates. Blocks up to maxPooledSize come from free lists of
+// size classes carved out of pages that are kept for the whole run, so the actors, shapes and
+// meshes created again on every rack reuse the same memory instead of going to the heap.
+// Larger blocks are allocated directly. Keeps live and peak bytes and the counts per PhysX type name.
+class PhysicsAllocator : public PxAllocatorCallback
+{
+public:
+    struct TypeStats
+    {
+        std::string name;
+        size_t liveBytes;
+        size_t liveCount;
+        size_t totalCount;
+    };
+
+    PhysicsAllocator();
+    virtual ~PhysicsAllocator();
+
+    void* allocate(size_t size, const char* typeName, const char* filename, int line) override;
+    void deallocate(void* ptr) override;
+
+    size_t getLiveBytes() const;
+    size_t getPeakBytes() const;
+    size_t getLiveCount() const;
+    size_t getTotalCount() const;
+    // memory reserved by the pools, used or not
+    size_t getPooledBytes() const;
+    // merged by name, the largest live bytes first
+    std::vector<TypeStats> getTypeStats() const;
+
+    // Logs the totals and the maxTypes types holding the most memory.
+    void report(const char* title, int maxTypes) const;
+
+private:
+    static const int numSizeClasses = 8;
+    static const size_t minBlockSize = 64;
+    static const size_t maxPooledSize = (minBlockSize << (numSizeClasses - 1)) - 16;
+    static const size_t pageSize = 64 * 1024;
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    void* allocatePooled(int sizeClass);
+    int findType(const char* typeName);
+
+    mutable std::mutex mutex;
+    FreeBlock* freeLists[numSizeClasses];
+    std::vector<void*> pages;
+    std::vector<TypeStats> types;
+    std::unordered_map<const char*, int> typeIndices;
+    size_t liveBytes = 0, peakBytes = 0, liveCount = 0, totalCount = 0;
+};
+
+// Bump allocator for the short-lived buffers of one rack, e.g. the output of cooking.
+// deallocate() does nothing, reset() rewinds to the start and keeps the memory for the next rack.
+// Used only from the simulation thread.
+class PhysicsArena : public PxAllocatorCallback
+{
+public:
+    explicit PhysicsArena(size_t blockSize = 256 * 1024);
+    virtual ~PhysicsArena();
+
+    void* allocate(size_t size, const char* typeName, const char* filename, int line) override;
+    void deallocate(void* /*ptr*/) override {}
+
+    void reset();
+
+    size_t getUsedBytes() const { return usedBytes; }
+    size_t getPeakBytes() const { return peakBytes; }
+    size_t getReservedBytes() const;
+
+private:
+    size_t blockSize;
+    // blocks with their sizes, the ones larger than blockSize hold a single allocation
+    std::vector<std::pair<char*, size_t>> blocks;
+    size_t currentBlock = 0, offset = 0;
+    size_t usedBytes = 0, peakBytes = 0;
+};
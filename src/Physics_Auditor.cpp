@@ -0,0 +1,96 @@
+#include "Physics_Auditor.h"
+
+#include <algorithm>
+
+#include "Logger.h"
+
+const char* PhysicsAuditor::categoryNames[numCategories] = { "actors", "shapes", "meshes", "materials" };
+
+PhysicsAuditor::PhysicsAuditor()
+{
+    std::fill(live, live + numCategories, 0);
+    std::fill(highest, highest + numCategories, 0);
+}
+
+int PhysicsAuditor::categoryOf(PxType type)
+{
+    switch (type) {
+    case PxConcreteType::eRIGID_DYNAMIC:
+    case PxConcreteType::eRIGID_STATIC:
+    case PxConcreteType::eARTICULATION_LINK:
+        return actors;
+    case PxConcreteType::eSHAPE:
+        return shapes;
+    case PxConcreteType::eCONVEX_MESH:
+    case PxConcreteType::eTRIANGLE_MESH_BVH33:
+    case PxConcreteType::eTRIANGLE_MESH_BVH34:
+    case PxConcreteType::eHEIGHTFIELD:
+        return meshes;
+    case PxConcreteType::eMATERIAL:
+        return materials;
+    default:
+        return -1;
+    }
+}
+
+void PhysicsAuditor::track(const PxBase& object)
+{
+    int category = categoryOf(object.getConcreteType());
+    if (category < 0 || !tracked.emplace(&object, category).second) return;
+    live[category]++;
+}
+
+void PhysicsAuditor::onRelease(const PxBase* observed, void* /*userData*/, PxDeletionEventFlag::Enum /*deletionEvent*/)
+{
+    // observed points to freed memory (eMEMORY_RELEASE), only its value is used
+    auto found = tracked.find(observed);
+    if (found == tracked.end()) return;
+    live[found->second]--;
+    tracked.erase(found);
+}
+
+bool PhysicsAuditor::checkRack(int rackId, size_t liveBytes)
+{
+    racksChecked++;
+    if (racksChecked <= warmUpRacks) {
+        for (int c = 0; c < numCategories; c++) {
+            highest[c] = std::max(highest[c], live[c]);
+        }
+        highestBytes = std::max(highestBytes, liveBytes);
+        return true;
+    }
+
+    bool grown = false;
+    for (int c = 0; c < numCategories; c++) {
+        if (live[c] > highest[c]) {
+            Core::Log(Core::LogLevel::Warning, "physics audit: rack %d has %d live %s, at most %d after the first %d racks",
+                rackId, live[c], categoryNames[c], highest[c], warmUpRacks);
+            // warn again only when it grows further
+            highest[c] = live[c];
+            grown = true;
+        }
+    }
+    if (liveBytes > highestBytes + bytesTolerance) {
+        Core::Log(Core::LogLevel::Warning, "physics audit: rack %d holds %.1f KB of physics memory, %.1f KB after the first %d racks",
+            rackId, liveBytes / 1024.0, highestBytes / 1024.0, warmUpRacks);
+        highestBytes = liveBytes;
+        grown = true;
+    }
+    if (grown) growthCount++;
+    return !grown;
+}
+
+void PhysicsAuditor::report(const char* title, const PxPhysics& physics) const
+{
+    Core::Log(Core::LogLevel::Info, "%s: %d racks checked, %d with growth, live: %d actors, %d shapes, %d meshes, %d materials",
+        title, racksChecked, growthCount, live[actors], live[shapes], live[meshes], live[materials]);
+
+    // objects created without track() would show up here
+    int physxShapes = (int)physics.getNbShapes();
+    int physxMeshes = (int)(physics.getNbConvexMeshes() + physics.getNbTriangleMeshes() + physics.getNbHeightFields());
+    int physxMaterials = (int)physics.getNbMaterials();
+    if (physxShapes != live[shapes] || physxMeshes != live[meshes] || physxMaterials != live[materials]) {
+        Core::Log(Core::LogLevel::Warning, "%s: PhysX counts %d shapes, %d meshes, %d materials, some objects are not tracked",
+            title, physxShapes, physxMeshes, physxMaterials);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <unordered_map>
+
+#include "PxPhysicsAPI.h"
+using namespace physx;
+
+// Counts the live PhysX objects of the game by category to catch leaks in long sessions.
+// Objects are counted when the game creates them (track()) and uncounted when PhysX frees
+// their memory (deletion listener), so an actor that is removed from the scene but never
+// released stays counted. checkRack() compares the counts after every rack with the highest
+// ones seen during the first racks and flags anything above them.
+// The memory of a released object is gone by the time the listener hears of it, so the category
+// is remembered per object in track() and looked up by the pointer value only.
+// Used from the thread that creates and releases the objects.
+class PhysicsAuditor : public PxDeletionListener
+{
+public:
+    enum Category { actors, shapes, meshes, materials, numCategories };
+
+    PhysicsAuditor();
+
+    void track(const PxBase& object);
+    void onRelease(const PxBase* observed, void* userData, PxDeletionEventFlag::Enum deletionEvent) override;
+
+    // Call after a rack is set up, liveBytes is what the physics allocator holds at that moment.
+    // Returns false if something grew above what the warm-up racks needed.
+    bool checkRack(int rackId, size_t liveBytes);
+
+    int getLiveCount(Category category) const { return live[category]; }
+    int getGrowthCount() const { return growthCount; }
+
+    // Logs the live counts, also against the numbers PhysX itself keeps where it has them.
+    void report(const char* title, const PxPhysics& physics) const;
+
+    static const char* categoryNames[numCategories];
+
+private:
+    static const int warmUpRacks = 10;
+    // allocator growth below this is noise (contact buffers, broad phase pairs)
+    static const size_t bytesTolerance = 256 * 1024;
+
+    static int categoryOf(PxType type);
+
+    std::unordered_map<const PxBase*, int> tracked;
+    int live[numCategories];
+    int highest[numCategories];
+    size_t highestBytes = 0;
+    int racksChecked = 0;
+    int growthCount = 0;
+};
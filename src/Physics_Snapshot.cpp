@@ -0,0 +1,39 @@
+#include "Physics_Snapshot.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "Logger.h"
+
+bool PhysicsSnapshot::serialize(PxCollection& collection, PxSerializationRegistry& registry, PxCollection* externals)
+{
+    PxSerialization::complete(collection, registry, externals);
+    if (!PxSerialization::isSerializable(collection, registry, externals)) {
+        Core::Log(Core::LogLevel::Error, "physics snapshot: the collection can't be serialized");
+        return false;
+    }
+
+    PxDefaultMemoryOutputStream stream;
+    if (!PxSerialization::serializeCollectionToBinary(stream, collection, registry, externals)) {
+        Core::Log(Core::LogLevel::Error, "physics snapshot: binary serialization failed");
+        return false;
+    }
+    data.assign(stream.getData(), stream.getData() + stream.getSize());
+    return true;
+}
+
+PxCollection* PhysicsSnapshot::instantiate(PxAllocatorCallback& allocator, PxSerializationRegistry& registry, const PxCollection* externals) const
+{
+    if (data.empty()) return nullptr;
+
+    // the binary data has to start at a PX_SERIAL_FILE_ALIGN boundary
+    char* block = (char*)allocator.allocate(data.size() + PX_SERIAL_FILE_ALIGN - 1, "PhysicsSnapshot", __FILE__, __LINE__);
+    if (!block) return nullptr;
+    void* memory = (void*)(((uintptr_t)block + PX_SERIAL_FILE_ALIGN - 1) & ~(uintptr_t)(PX_SERIAL_FILE_ALIGN - 1));
+    memcpy(memory, &data[0], data.size());
+
+    PxCollection* collection = PxSerialization::createCollectionFromBinary(memory, registry, externals);
+    if (!collection)
+        Core::Log(Core::LogLevel::Error, "physics snapshot: can't create the objects from %zu bytes", data.size());
+    return collection;
+}
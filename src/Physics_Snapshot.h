@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include "PxPhysicsAPI.h"
+using namespace physx;
+
+// A set of configured PhysX objects kept as a binary collection (PxSerialization), to be created
+// again any number of times without cooking and with no allocation per object: the objects are
+// built in place in a copy of the data.
+class PhysicsSnapshot
+{
+public:
+    // Serializes the objects of the collection, completed with everything they need except for
+    // the objects in externals, which stay references (they need serial object ids).
+    bool serialize(PxCollection& collection, PxSerializationRegistry& registry, PxCollection* externals = nullptr);
+
+    // Creates the objects in a copy of the data taken from allocator. The memory has to stay
+    // until all the objects are released, so it is never returned to the allocator here.
+    // externals has to hold the referenced objects under the ids they were serialized with.
+    // The returned collection only lists the objects, release() it once they are picked up.
+    PxCollection* instantiate(PxAllocatorCallback& allocator, PxSerializationRegistry& registry, const PxCollection* externals = nullptr) const;
+
+    bool isEmpty() const { return data.empty(); }
+    size_t getSize() const { return data.size(); }
+
+private:
+    std::vector<unsigned char> data;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace Core
+{
+	// Bounded lock-free queue for many producers and many consumers (D. Vyukov's scheme).
+	// Capacity has to be a power of two. Push and Pop never block - they return false
+	// when the queue is full or empty respectively.
+	template <typename T, size_t Capacity>
+	class RingBuffer
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+	public:
+		RingBuffer()
+		{
+			for (size_t i = 0; i < Capacity; i++)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			enqueuePos.store(0, std::memory_order_relaxed);
+			dequeuePos.store(0, std::memory_order_relaxed);
+		}
+
+		bool Push(const T & value)
+		{
+			size_t pos = enqueuePos.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				Cell & cell = cells[pos & (Capacity - 1)];
+				size_t seq = cell.sequence.load(std::memory_order_acquire);
+				ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+				if (diff == 0)
+				{
+					if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						cell.data = value;
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false;
+				else
+					pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		bool Pop(T & value)
+		{
+			size_t pos = dequeuePos.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				Cell & cell = cells[pos & (Capacity - 1)];
+				size_t seq = cell.sequence.load(std::memory_order_acquire);
+				ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)(pos + 1);
+				if (diff == 0)
+				{
+					if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						value = cell.data;
+						cell.sequence.store(pos + Capacity, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+					return false;
+				else
+					pos = dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T data;
+		};
+
+		// producers and consumers work on separate cache lines
+		alignas(64) Cell cells[Capacity];
+		alignas(64) std::atomic<size_t> enqueuePos;
+		alignas(64) std::atomic<size_t> dequeuePos;
+	};
+}
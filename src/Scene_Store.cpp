@@ -0,0 +1,85 @@
+#include "Scene_Store.h"
+
+#include <algorithm>
+
+using namespace Core;
+
+SceneHandle SceneStore::Create(int modelId, int textureLayer, const glm::mat4 & localTransform)
+{
+	unsigned slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = (unsigned)slotIndices.size();
+		slotIndices.push_back(-1);
+		slotGenerations.push_back(0);
+	}
+	// generations start at 1, so no handle is ever equal to InvalidSceneHandle
+	slotGenerations[slot]++;
+	SceneHandle handle = (slotGenerations[slot] << slotBits) | slot;
+
+	slotIndices[slot] = Size();
+	handles.push_back(handle);
+	modelIds.push_back(modelId);
+	textureLayers.push_back(textureLayer);
+	localTransforms.push_back(localTransform);
+	worldPoses.push_back({ 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f });
+	visible.push_back(0);
+	return handle;
+}
+
+void SceneStore::Destroy(SceneHandle handle)
+{
+	int index = IndexOf(handle);
+	if (index < 0) return;
+
+	// keep the arrays packed by moving the last entity into the hole
+	int last = Size() - 1;
+	handles[index] = handles[last];
+	modelIds[index] = modelIds[last];
+	textureLayers[index] = textureLayers[last];
+	localTransforms[index] = localTransforms[last];
+	worldPoses[index] = worldPoses[last];
+	visible[index] = visible[last];
+	slotIndices[handles[index] & slotMask] = index;
+
+	handles.pop_back();
+	modelIds.pop_back();
+	textureLayers.pop_back();
+	localTransforms.pop_back();
+	worldPoses.pop_back();
+	visible.pop_back();
+
+	unsigned slot = handle & slotMask;
+	slotIndices[slot] = -1;
+	freeSlots.push_back(slot);
+}
+
+bool SceneStore::IsValid(SceneHandle handle) const
+{
+	return IndexOf(handle) >= 0;
+}
+
+void SceneStore::SetWorldPose(SceneHandle handle, const RigidPose & worldPose)
+{
+	int index = IndexOf(handle);
+	if (index < 0) return;
+	worldPoses[index] = worldPose;
+	visible[index] = 1;
+}
+
+void SceneStore::HideAll()
+{
+	std::fill(visible.begin(), visible.end(), 0);
+}
+
+int SceneStore::IndexOf(SceneHandle handle) const
+{
+	unsigned slot = handle & slotMask;
+	if (slot >= slotIndices.size() || slotGenerations[slot] != handle >> slotBits) return -1;
+	return slotIndices[slot];
+}
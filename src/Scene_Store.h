@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include "glm.hpp"
+#include "Transform_Batch.h"
+
+namespace Core
+{
+	// Stable reference to an entity of a SceneStore. Stays valid until the entity is destroyed,
+	// no matter how the packed arrays get compacted; a destroyed handle is never valid again.
+	// It fits in a pointer, so it can be kept in PxActor::userData.
+	typedef unsigned SceneHandle;
+	const SceneHandle InvalidSceneHandle = 0;
+
+	// Structure-of-arrays storage of the renderable entities. Each property lives in its own
+	// packed array and index i describes the same entity in all of them, so per-frame passes
+	// (transform sync, culling, drawing) walk contiguous memory. Every entity has exactly one slot,
+	// so it can't end up drawn twice.
+	class SceneStore
+	{
+	public:
+		SceneHandle Create(int modelId, int textureLayer, const glm::mat4 & localTransform);
+		void Destroy(SceneHandle handle);
+		bool IsValid(SceneHandle handle) const;
+
+		// Sets the world pose of the entity and marks it visible until the next HideAll().
+		void SetWorldPose(SceneHandle handle, const RigidPose & worldPose);
+		void HideAll();
+
+		int Size() const { return (int)handles.size(); }
+		const SceneHandle * GetHandles() const { return handles.data(); }
+		const int * GetModelIds() const { return modelIds.data(); }
+		const int * GetTextureLayers() const { return textureLayers.data(); }
+		const glm::mat4 * GetLocalTransforms() const { return localTransforms.data(); }
+		const RigidPose * GetWorldPoses() const { return worldPoses.data(); }
+		const unsigned char * GetVisible() const { return visible.data(); }
+
+	private:
+		static const int slotBits = 16;
+		static const unsigned slotMask = (1u << slotBits) - 1;
+
+		int IndexOf(SceneHandle handle) const;
+
+		// packed arrays
+		std::vector<SceneHandle> handles;
+		std::vector<int> modelIds;
+		std::vector<int> textureLayers;
+		std::vector<glm::mat4> localTransforms;
+		std::vector<RigidPose> worldPoses;
+		std::vector<unsigned char> visible;
+
+		// handle slot -> packed index, generation of the slot and the slots free for reuse
+		std::vector<int> slotIndices;
+		std::vector<unsigned> slotGenerations;
+		std::vector<unsigned> freeSlots;
+	};
+}
@@ -0,0 +1,386 @@
+#include "Score_Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+#include "Logger.h"
+#include "Ring_Buffer.h"
+
+namespace
+{
+	using Core::ScoreRecord;
+
+	// log: LogHeader, then the records in the order they were appended
+	// index (<log>.idx): IndexHeader, then one IndexEntry per bowler sorted by name, each the range
+	// of the bowler's records in the compacted start of the log; records after it are not indexed
+	struct LogHeader
+	{
+		unsigned magic;
+		unsigned version;
+		// changes with every compaction, an index from another one is ignored
+		unsigned generation;
+		unsigned recordSize;
+	};
+
+	struct IndexHeader
+	{
+		unsigned magic;
+		unsigned version;
+		unsigned generation;
+		unsigned indexedRecords;
+		unsigned numEntries;
+	};
+
+	struct IndexEntry
+	{
+		char bowler[ScoreRecord::maxName];
+		unsigned first;
+		unsigned count;
+	};
+
+	static_assert(sizeof(ScoreRecord) == 52, "the score log layout changed");
+
+	const unsigned logMagic = ('B' << 0) | ('S' << 8) | ('L' << 16) | ('G' << 24);
+	const unsigned indexMagic = ('B' << 0) | ('S' << 8) | ('I' << 16) | ('X' << 24);
+	const unsigned logVersion = 1;
+
+	std::string IndexPath(const char * filepath)
+	{
+		return std::string(filepath) + ".idx";
+	}
+
+	bool SameBowler(const char * a, const char * b)
+	{
+		return memcmp(a, b, ScoreRecord::maxName) == 0;
+	}
+
+	bool ReadHeader(FILE * file, LogHeader & header)
+	{
+		return fread(&header, sizeof(header), 1, file) == 1 && header.magic == logMagic
+			&& header.version == logVersion && header.recordSize == sizeof(ScoreRecord);
+	}
+
+	// whole records only, one cut off by a crash is left out
+	size_t CountRecords(FILE * file)
+	{
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		return size > (long)sizeof(LogHeader) ? (size - sizeof(LogHeader)) / sizeof(ScoreRecord) : 0;
+	}
+
+	void ReadRecords(FILE * file, size_t first, size_t count, std::vector<ScoreRecord> & records)
+	{
+		size_t start = records.size();
+		records.resize(start + count);
+		fseek(file, (long)(sizeof(LogHeader) + first * sizeof(ScoreRecord)), SEEK_SET);
+		if (count > 0)
+			records.resize(start + fread(&records[start], sizeof(ScoreRecord), count, file));
+	}
+
+	bool ReadIndex(const char * filepath, unsigned generation, IndexHeader & header, std::vector<IndexEntry> & entries)
+	{
+		FILE * file = fopen(IndexPath(filepath).c_str(), "rb");
+		if (!file) return false;
+		bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == indexMagic
+			&& header.version == logVersion && header.generation == generation;
+		if (valid)
+		{
+			entries.resize(header.numEntries);
+			valid = header.numEntries == 0 || fread(&entries[0], sizeof(IndexEntry), header.numEntries, file) == header.numEntries;
+		}
+		fclose(file);
+		return valid;
+	}
+
+	// one record per game where it first appeared, a later record of the game replaces the earlier
+	void KeepLatest(const std::vector<ScoreRecord> & records, std::vector<ScoreRecord> & games)
+	{
+		std::unordered_map<unsigned, size_t> gameIndex;
+		for (const ScoreRecord & record : records)
+		{
+			auto found = gameIndex.find(record.gameId);
+			if (found != gameIndex.end())
+				games[found->second] = record;
+			else
+			{
+				gameIndex[record.gameId] = games.size();
+				games.push_back(record);
+			}
+		}
+	}
+
+	bool WriteFile(const std::string & path, const void * header, size_t headerSize, const void * data, size_t dataSize)
+	{
+		FILE * file = fopen(path.c_str(), "wb");
+		if (!file) return false;
+		bool written = fwrite(header, headerSize, 1, file) == 1 && (dataSize == 0 || fwrite(data, dataSize, 1, file) == 1);
+		return fclose(file) == 0 && written;
+	}
+
+	// replaces to in one step, there is no moment without either file
+	bool SwapInFile(const std::string & from, const std::string & to)
+	{
+#ifdef _WIN32
+		// rename() does not overwrite an existing file on Windows
+		return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+		return rename(from.c_str(), to.c_str()) == 0;
+#endif
+	}
+
+	bool IsScoreLog(const char * filepath)
+	{
+		FILE * file = fopen(filepath, "rb");
+		if (!file) return false;
+		LogHeader header;
+		bool valid = ReadHeader(file, header);
+		fclose(file);
+		return valid;
+	}
+
+	bool Compact(const char * filepath, unsigned & maxGameId)
+	{
+		LogHeader header = { logMagic, logVersion, 0, sizeof(ScoreRecord) };
+		std::vector<ScoreRecord> records;
+		if (FILE * file = fopen(filepath, "rb"))
+		{
+			LogHeader previous;
+			if (!ReadHeader(file, previous))
+			{
+				fclose(file);
+				Core::Log(Core::LogLevel::Error, "score log: %s is not a score log of this version, leaving it alone", filepath);
+				return false;
+			}
+			header.generation = previous.generation + 1;
+			ReadRecords(file, 0, CountRecords(file), records);
+			fclose(file);
+		}
+
+		std::vector<ScoreRecord> games;
+		KeepLatest(records, games);
+		// the order within a bowler stays the order the games were started in
+		std::stable_sort(games.begin(), games.end(), [](const ScoreRecord & a, const ScoreRecord & b) {
+			return memcmp(a.bowler, b.bowler, ScoreRecord::maxName) < 0;
+		});
+		maxGameId = 0;
+		std::vector<IndexEntry> entries;
+		for (size_t i = 0; i < games.size(); i++)
+		{
+			maxGameId = std::max(maxGameId, games[i].gameId);
+			if (entries.empty() || !SameBowler(entries.back().bowler, games[i].bowler))
+			{
+				IndexEntry entry;
+				memcpy(entry.bowler, games[i].bowler, ScoreRecord::maxName);
+				entry.first = (unsigned)i;
+				entry.count = 0;
+				entries.push_back(entry);
+			}
+			entries.back().count++;
+		}
+		IndexHeader indexHeader = { indexMagic, logVersion, header.generation, (unsigned)games.size(), (unsigned)entries.size() };
+
+		// written next to the old files and swapped in, a crash leaves either the old or the new log;
+		// the index is swapped second, readers ignore it while its generation does not match
+		std::string logTemp = std::string(filepath) + ".tmp", indexTemp = IndexPath(filepath) + ".tmp";
+		if (!WriteFile(logTemp, &header, sizeof(header), games.empty() ? nullptr : &games[0], games.size() * sizeof(ScoreRecord))
+			|| !WriteFile(indexTemp, &indexHeader, sizeof(indexHeader), entries.empty() ? nullptr : &entries[0], entries.size() * sizeof(IndexEntry))
+			|| !SwapInFile(logTemp, filepath) || !SwapInFile(indexTemp, IndexPath(filepath)))
+		{
+			Core::Log(Core::LogLevel::Error, "score log: can't compact %s", filepath);
+			return false;
+		}
+		Core::Log(Core::LogLevel::Debug, "score log: compacted %s, %zu records into %zu games of %zu bowlers",
+			filepath, records.size(), games.size(), entries.size());
+		return true;
+	}
+
+	class ScoreWriter
+	{
+	public:
+		ScoreWriter() : running(false), nextGameId(1), file(nullptr), appended(0), compactRecords(0) {}
+		~ScoreWriter() { Stop(); }
+
+		bool Start(const char * filepath, int compactAfter)
+		{
+			if (running.load()) return false;
+			compactRecords = std::max(1, compactAfter);
+			appended = 0;
+			nextCompact = std::chrono::steady_clock::time_point();
+			unsigned maxGameId;
+			if (!Compact(filepath, maxGameId))
+			{
+				// the game ids are known before anything is written, so a log that is only left
+				// uncompacted (the swap failed) is still used and compacted later
+				if (!IsScoreLog(filepath)) return false;
+				appended = compactRecords;
+				nextCompact = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			}
+			file = fopen(filepath, "ab");
+			if (!file)
+			{
+				Core::Log(Core::LogLevel::Error, "score log: can't open %s", filepath);
+				return false;
+			}
+			path = filepath;
+			nextGameId.store(maxGameId + 1);
+			running.store(true);
+			worker = std::thread(&ScoreWriter::Run, this);
+			return true;
+		}
+
+		void Stop()
+		{
+			if (!running.exchange(false)) return;
+			worker.join();
+			Write();
+			if (file)
+				fclose(file);
+			file = nullptr;
+			unsigned maxGameId;
+			Compact(path.c_str(), maxGameId);
+		}
+
+		void Run()
+		{
+			while (running.load(std::memory_order_relaxed))
+			{
+				if (!Write() && !CompactIfDue())
+					std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			}
+		}
+
+		bool CompactIfDue()
+		{
+			if (appended < compactRecords || std::chrono::steady_clock::now() < nextCompact) return false;
+			if (file)
+				fclose(file);
+			unsigned maxGameId;
+			if (Compact(path.c_str(), maxGameId))
+				appended = 0;
+			else
+				// on Windows the swap fails while another program reads the log, so it is tried again soon
+				// instead of after the next compactRecords records
+				nextCompact = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+			file = fopen(path.c_str(), "ab");
+			return true;
+		}
+
+		bool Write()
+		{
+			ScoreRecord record;
+			int written = 0;
+			while (queue.Pop(record))
+			{
+				if (!file || fwrite(&record, sizeof(record), 1, file) != 1)
+					Core::Log(Core::LogLevel::Error, "score log: can't write game %u of %.16s to %s", record.gameId, record.bowler, path.c_str());
+				written++;
+			}
+			if (written == 0) return false;
+			if (file)
+				fflush(file);
+
+			appended += written;
+			CompactIfDue();
+			return true;
+		}
+
+		Core::RingBuffer<ScoreRecord, 1024> queue;
+		std::thread worker;
+		std::atomic<bool> running;
+		std::atomic<unsigned> nextGameId;
+		std::string path;
+		FILE * file;
+		int appended;
+		int compactRecords;
+		std::chrono::steady_clock::time_point nextCompact;
+	};
+
+	ScoreWriter writer;
+}
+
+bool Core::StartScoreLog(const char * filepath, int compactRecords)
+{
+	return writer.Start(filepath, compactRecords);
+}
+
+void Core::StopScoreLog()
+{
+	writer.Stop();
+}
+
+bool Core::AppendScoreRecord(const ScoreRecord & record)
+{
+	if (!writer.running.load(std::memory_order_relaxed)) return false;
+	if (writer.queue.Push(record)) return true;
+	Log(LogLevel::Warning, "score log: queue full, game %u of %.16s not saved", record.gameId, record.bowler);
+	return false;
+}
+
+unsigned Core::NewScoreGameId()
+{
+	return writer.nextGameId.fetch_add(1);
+}
+
+bool Core::CompactScoreLog(const char * filepath)
+{
+	unsigned maxGameId;
+	return Compact(filepath, maxGameId);
+}
+
+bool Core::ReadBowlerGames(const char * filepath, const char * bowler, std::vector<ScoreRecord> & games)
+{
+	FILE * file = fopen(filepath, "rb");
+	if (!file) return false;
+	LogHeader header;
+	if (!ReadHeader(file, header))
+	{
+		fclose(file);
+		return false;
+	}
+	size_t numRecords = CountRecords(file);
+
+	ScoreRecord key;
+	SetRecordBowler(key, bowler);
+	std::vector<ScoreRecord> records;
+	size_t tailStart = 0;
+	IndexHeader indexHeader;
+	std::vector<IndexEntry> entries;
+	if (ReadIndex(filepath, header.generation, indexHeader, entries) && indexHeader.indexedRecords <= numRecords)
+	{
+		tailStart = indexHeader.indexedRecords;
+		auto entry = std::lower_bound(entries.begin(), entries.end(), key, [](const IndexEntry & e, const ScoreRecord & k) {
+			return memcmp(e.bowler, k.bowler, ScoreRecord::maxName) < 0;
+		});
+		if (entry != entries.end() && SameBowler(entry->bowler, key.bowler))
+			ReadRecords(file, entry->first, entry->count, records);
+	}
+
+	std::vector<ScoreRecord> tail;
+	ReadRecords(file, tailStart, numRecords - tailStart, tail);
+	fclose(file);
+	for (const ScoreRecord & record : tail)
+	{
+		if (SameBowler(record.bowler, key.bowler))
+			records.push_back(record);
+	}
+	games.clear();
+	KeepLatest(records, games);
+	return true;
+}
+
+void Core::SetRecordBowler(ScoreRecord & record, const char * name)
+{
+	memset(record.bowler, 0, sizeof(record.bowler));
+	strncpy(record.bowler, name, sizeof(record.bowler));
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include "Bowling_Score.h"
+
+namespace Core
+{
+	enum class ScoreRecordType : unsigned char
+	{
+		// a frame was completed, the rolls are the game so far
+		Frame,
+		// the game is over, the rolls are the whole game
+		Game
+	};
+
+	// One entry of the score log. Fixed size (52 bytes), so records are addressed by their number.
+	struct ScoreRecord
+	{
+		static const int maxName = 16;
+
+		unsigned gameId;
+		// seconds since 1970
+		unsigned time;
+		// padded with zeros, not terminated when the name takes all 16 characters
+		char bowler[maxName];
+		ScoreRecordType type;
+		unsigned char lane;
+		unsigned char frames;
+		unsigned char numRolls;
+		unsigned char rolls[BowlingGame::maxRolls];
+		unsigned char reserved;
+		// total of the frames scored so far
+		short score;
+	};
+
+	// Starts the writer thread, which appends the queued records to the binary log at filepath
+	// (created if missing). The log is compacted when it starts, after every compactRecords
+	// appended records and when it stops.
+	bool StartScoreLog(const char * filepath, int compactRecords = 4096);
+
+	// Writes what is left in the queue, compacts the log and joins the writer thread.
+	void StopScoreLog();
+
+	// Queues a record for the writer thread. Safe to call from any thread, never blocks and never
+	// touches the disk; returns false if the log is not started or the queue is full.
+	bool AppendScoreRecord(const ScoreRecord & record);
+
+	// Id for a new game, the ids continue after the largest one in the log.
+	unsigned NewScoreGameId();
+
+	// Rewrites the log with one record per game (the Game record, or the last Frame record of a
+	// game that was never finished) sorted by bowler and time, and writes the index next to it
+	// (<filepath>.idx). The writer does it by itself, call it only while the log is not started.
+	bool CompactScoreLog(const char * filepath);
+
+	// Games of a bowler, oldest first, one record each (unfinished games as their last frame).
+	// Reads the bowler's range from the index and the records appended since the last compaction;
+	// it only reads the files, so other programs can query while the game is writing.
+	bool ReadBowlerGames(const char * filepath, const char * bowler, std::vector<ScoreRecord> & games);
+
+	// Copies a name into a record's bowler field, cutting it to maxName characters.
+	void SetRecordBowler(ScoreRecord & record, const char * name);
+}
@@ -2,11 +2,186 @@
 #include<iostream>
 #include<fstream>
 #include<vector>
+#include<iterator>
+#include<chrono>
+#include<cstdio>
+#include<cstring>
+#include<sys/stat.h>
+#ifdef _WIN32
+#include<direct.h>
+#endif
+#ifdef __linux__
+#include<sys/inotify.h>
+#include<unistd.h>
+#include<fcntl.h>
+#endif
+#include "Logger.h"
 
 using namespace Core;
 
-Shader_Loader::Shader_Loader(void){}
-Shader_Loader::~Shader_Loader(void){}
+namespace
+{
+	struct CacheHeader
+	{
+		unsigned magic;
+		unsigned version;
+		GLenum format;
+		GLint length;
+		double compileMilliseconds;
+	};
+
+	const unsigned cacheMagic = ('G' << 0) | ('R' << 8) | ('K' << 16) | ('S' << 24);
+	const unsigned cacheVersion = 1;
+
+	unsigned long long Fnv1a(unsigned long long hash, const char * data, size_t size)
+	{
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= (unsigned char)data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	void MakeDirectory(const std::string & path)
+	{
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	bool TryReadFile(const std::string & filename, std::string & contents)
+	{
+		std::ifstream file(filename, std::ios::in | std::ios::binary);
+		if (!file.good()) return false;
+		contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		return true;
+	}
+
+	std::string DirectoryOf(const std::string & filename)
+	{
+		size_t slash = filename.find_last_of("/\\");
+		return slash == std::string::npos ? "." : filename.substr(0, slash);
+	}
+
+	// logs the info log of a shader or program, returns false if compilation/linking failed
+	bool CheckStatus(GLuint object, GLenum statusType, const char * name)
+	{
+		int result = 0;
+		bool isProgram = statusType == GL_LINK_STATUS;
+		if (isProgram)
+			glGetProgramiv(object, statusType, &result);
+		else
+			glGetShaderiv(object, statusType, &result);
+		if (result != GL_FALSE) return true;
+
+		int info_log_length = 0;
+		if (isProgram)
+			glGetProgramiv(object, GL_INFO_LOG_LENGTH, &info_log_length);
+		else
+			glGetShaderiv(object, GL_INFO_LOG_LENGTH, &info_log_length);
+		std::vector<char> log(info_log_length + 1);
+		if (isProgram)
+			glGetProgramInfoLog(object, info_log_length, NULL, &log[0]);
+		else
+			glGetShaderInfoLog(object, info_log_length, NULL, &log[0]);
+		Log(LogLevel::Error, "shader reload: %s failed\n%s", name, &log[0]);
+		return false;
+	}
+}
+
+Shader_Loader::Shader_Loader(const char * cacheDirectory) : cacheDirectory(cacheDirectory), savedMilliseconds(0), watchHandle(-1) {}
+Shader_Loader::~Shader_Loader(void)
+{
+#ifdef __linux__
+	if (watchHandle >= 0) close(watchHandle);
+#endif
+}
+
+unsigned long long Shader_Loader::HashSources(const std::string & vertexSource, const std::string & fragmentSource)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	hash = Fnv1a(hash, vertexSource.data(), vertexSource.size());
+	hash = Fnv1a(hash, "\0", 1);
+	hash = Fnv1a(hash, fragmentSource.data(), fragmentSource.size());
+
+	// binaries are only valid for the driver that produced them
+	const char * strings[] = { (const char *)glGetString(GL_VENDOR), (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION) };
+	for (const char * str : strings)
+		if (str) hash = Fnv1a(hash, str, strlen(str));
+	return hash;
+}
+
+std::string Shader_Loader::CachePath(unsigned long long hash)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.bin", hash);
+	return cacheDirectory + name;
+}
+
+GLuint Shader_Loader::LoadCachedProgram(unsigned long long hash)
+{
+	if (!GLEW_ARB_get_program_binary) return 0;
+
+	std::ifstream file(CachePath(hash), std::ios::binary);
+	if (!file.good()) return 0;
+
+	auto start = std::chrono::steady_clock::now();
+	CacheHeader header;
+	if (!file.read((char *)&header, sizeof(header)) || header.magic != cacheMagic || header.version != cacheVersion || header.length <= 0)
+		return 0;
+	std::vector<char> binary(header.length);
+	if (!file.read(&binary[0], header.length))
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, &binary[0], header.length);
+	int link_result = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_result);
+	if (link_result == GL_FALSE)
+	{
+		// e.g. after a driver update - compile from source and overwrite the entry
+		Log(LogLevel::Warning, "shader cache: driver rejected %s, compiling from source", CachePath(hash).c_str());
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	double loadMilliseconds = MillisecondsSince(start);
+	savedMilliseconds += header.compileMilliseconds - loadMilliseconds;
+	Log(LogLevel::Info, "shader cache: program loaded in %.2f ms instead of %.2f ms compile (saved %.2f ms in total)",
+		loadMilliseconds, header.compileMilliseconds, savedMilliseconds);
+	return program;
+}
+
+void Shader_Loader::StoreCachedProgram(GLuint program, unsigned long long hash, double compileMilliseconds)
+{
+	if (!GLEW_ARB_get_program_binary) return;
+
+	CacheHeader header;
+	header.magic = cacheMagic;
+	header.version = cacheVersion;
+	header.compileMilliseconds = compileMilliseconds;
+	header.length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &header.length);
+	if (header.length <= 0) return;
+
+	std::vector<char> binary(header.length);
+	glGetProgramBinary(program, header.length, &header.length, &header.format, &binary[0]);
+
+	MakeDirectory(cacheDirectory);
+	std::ofstream file(CachePath(hash), std::ios::binary);
+	file.write((const char *)&header, sizeof(header));
+	file.write(&binary[0], header.length);
+	if (!file.good())
+		Log(LogLevel::Warning, "shader cache: can't write %s", CachePath(hash).c_str());
+}
 
 std::string Shader_Loader::ReadShader(char *filename)
 {
@@ -65,6 +240,13 @@ GLuint Shader_Loader::CreateProgram(char* vertexShaderFilename,
 	std::string vertex_shader_code = ReadShader(vertexShaderFilename);
 	std::string fragment_shader_code = ReadShader(fragmentShaderFilename);
 
+	unsigned long long hash = HashSources(vertex_shader_code, fragment_shader_code);
+	GLuint cached_program = LoadCachedProgram(hash);
+	if (cached_program)
+		return cached_program;
+
+	auto compile_start = std::chrono::steady_clock::now();
+
 	GLuint vertex_shader = CreateShader(GL_VERTEX_SHADER, vertex_shader_code, "vertex shader");
 	GLuint fragment_shader = CreateShader(GL_FRAGMENT_SHADER, fragment_shader_code, "fragment shader");
 
@@ -74,6 +256,8 @@ GLuint Shader_Loader::CreateProgram(char* vertexShaderFilename,
 	glAttachShader(program, vertex_shader);
 	glAttachShader(program, fragment_shader);
 
+	if (GLEW_ARB_get_program_binary)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(program);
 	glGetProgramiv(program, GL_LINK_STATUS, &link_result);
 	//sprawdz bledy w linkerze
@@ -93,6 +277,8 @@ GLuint Shader_Loader::CreateProgram(char* vertexShaderFilename,
 	glDeleteShader(vertex_shader);
 	glDeleteShader(fragment_shader);
 
+	StoreCachedProgram(program, hash, MillisecondsSince(compile_start));
+
 	return program;
 }
 
@@ -100,3 +286,150 @@ void Shader_Loader::DeleteProgram( GLuint program )
 {
 	glDeleteProgram(program);
 }
+
+void Shader_Loader::WatchProgram(GLuint * program, char* vertexShaderFilename, char* fragmentShaderFilename)
+{
+	WatchedProgram watched;
+	watched.program = program;
+	watched.vertexFilename = vertexShaderFilename;
+	watched.fragmentFilename = fragmentShaderFilename;
+	std::string vertexSource, fragmentSource;
+	watched.sourceHash = ReadSources(watched, vertexSource, fragmentSource) ? HashSources(vertexSource, fragmentSource) : 0;
+	watched.pendingProgram = 0;
+	watched.pendingHash = 0;
+	watched.changed = false;
+	watchedPrograms.push_back(watched);
+
+	if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+#ifdef __linux__
+	// editors usually replace the file, so the directories are watched instead of the files
+	if (watchHandle < 0)
+		watchHandle = inotify_init1(IN_NONBLOCK);
+	if (watchHandle >= 0)
+	{
+		inotify_add_watch(watchHandle, DirectoryOf(watched.vertexFilename).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		inotify_add_watch(watchHandle, DirectoryOf(watched.fragmentFilename).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	}
+#endif
+}
+
+bool Shader_Loader::WatchedFilesTouched()
+{
+#ifdef __linux__
+	if (watchHandle >= 0)
+	{
+		char events[4096];
+		bool touched = false;
+		while (read(watchHandle, events, sizeof(events)) > 0)
+			touched = true;
+		return touched;
+	}
+#endif
+	// no change notifications - poll the modification times twice a second
+	if (MillisecondsSince(lastPoll) < 500.0) return false;
+	lastPoll = std::chrono::steady_clock::now();
+	return true;
+}
+
+bool Shader_Loader::ReadSources(const WatchedProgram & watched, std::string & vertexSource, std::string & fragmentSource)
+{
+	return TryReadFile(watched.vertexFilename, vertexSource) && TryReadFile(watched.fragmentFilename, fragmentSource);
+}
+
+void Shader_Loader::StartReload(WatchedProgram & watched)
+{
+	std::string vertexSource, fragmentSource;
+	if (!ReadSources(watched, vertexSource, fragmentSource))
+		return;
+
+	// compile and link without asking for the status - the driver may do the work on its own threads
+	watched.pendingHash = HashSources(vertexSource, fragmentSource);
+	watched.sourceHash = watched.pendingHash;
+	watched.compileStart = std::chrono::steady_clock::now();
+	GLuint program = glCreateProgram();
+	const std::string * sources[] = { &vertexSource, &fragmentSource };
+	const GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	for (int i = 0; i < 2; i++)
+	{
+		GLuint shader = glCreateShader(types[i]);
+		const char * code = sources[i]->c_str();
+		const int size = (int)sources[i]->size();
+		glShaderSource(shader, 1, &code, &size);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		glDeleteShader(shader);	// freed together with the program
+	}
+	if (GLEW_ARB_get_program_binary)
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
+	watched.pendingProgram = program;
+}
+
+bool Shader_Loader::FinishReload(WatchedProgram & watched)
+{
+	GLuint program = watched.pendingProgram;
+	// without the extension the status queries below wait for the driver, see UpdateHotReload in the header
+	if (GLEW_ARB_parallel_shader_compile)
+	{
+		int completed = 0;
+		glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &completed);
+		if (!completed) return false;
+	}
+	watched.pendingProgram = 0;
+
+	GLuint shaders[2];
+	GLsizei count = 0;
+	glGetAttachedShaders(program, 2, &count, shaders);
+	bool ok = true;
+	for (int i = 0; i < count; i++)
+	{
+		int type = 0;
+		glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+		const std::string & name = type == GL_VERTEX_SHADER ? watched.vertexFilename : watched.fragmentFilename;
+		ok = CheckStatus(shaders[i], GL_COMPILE_STATUS, name.c_str()) && ok;
+	}
+	ok = ok && CheckStatus(program, GL_LINK_STATUS, "linking");
+	if (!ok)
+	{
+		Log(LogLevel::Warning, "shader reload: keeping the previous version of %s + %s", watched.vertexFilename.c_str(), watched.fragmentFilename.c_str());
+		glDeleteProgram(program);
+		return false;
+	}
+
+	double compileMilliseconds = MillisecondsSince(watched.compileStart);
+	for (int i = 0; i < count; i++)
+		glDetachShader(program, shaders[i]);
+	StoreCachedProgram(program, watched.pendingHash, compileMilliseconds);
+
+	glDeleteProgram(*watched.program);
+	*watched.program = program;
+	Log(LogLevel::Info, "shader reload: %s + %s swapped in after %.1f ms", watched.vertexFilename.c_str(), watched.fragmentFilename.c_str(), compileMilliseconds);
+	return true;
+}
+
+bool Shader_Loader::UpdateHotReload()
+{
+	bool swapped = false;
+	bool touched = WatchedFilesTouched();
+	for (WatchedProgram & watched : watchedPrograms)
+	{
+		// decided on the contents: two saves within a second have the same modification time
+		std::string vertexSource, fragmentSource;
+		if (touched && ReadSources(watched, vertexSource, fragmentSource) && HashSources(vertexSource, fragmentSource) != watched.sourceHash)
+			watched.changed = true;
+
+		if (watched.pendingProgram)
+		{
+			swapped = FinishReload(watched) || swapped;
+			if (watched.pendingProgram) continue;
+		}
+		if (watched.changed)
+		{
+			watched.changed = false;
+			StartReload(watched);
+		}
+	}
+	return swapped;
+}
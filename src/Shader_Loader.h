@@ -3,6 +3,9 @@
 #include "glew.h"
 #include "freeglut.h"
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <vector>
 
 namespace Core
 {
@@ -16,14 +19,57 @@ namespace Core
 			std::string source,
 			char* shaderName);
 
+		// cache zlinkowanych programow (glGetProgramBinary), kluczem jest hash zrodel shaderow i sterownika
+		std::string cacheDirectory;
+		double savedMilliseconds;
+		unsigned long long HashSources(const std::string & vertexSource, const std::string & fragmentSource);
+		std::string CachePath(unsigned long long hash);
+		GLuint LoadCachedProgram(unsigned long long hash);
+		void StoreCachedProgram(GLuint program, unsigned long long hash, double compileMilliseconds);
+
+		// przeladowywanie shaderow w trakcie dzialania programu
+		struct WatchedProgram
+		{
+			GLuint * program;
+			std::string vertexFilename, fragmentFilename;
+			// hash zrodel ostatnio kompilowanej wersji - plik zapisany bez zmian nie jest kompilowany ponownie
+			unsigned long long sourceHash;
+			bool changed;
+			GLuint pendingProgram;
+			unsigned long long pendingHash;
+			std::chrono::steady_clock::time_point compileStart;
+		};
+		std::vector<WatchedProgram> watchedPrograms;
+		int watchHandle;
+		std::chrono::steady_clock::time_point lastPoll;
+		bool WatchedFilesTouched();
+		bool ReadSources(const WatchedProgram & watched, std::string & vertexSource, std::string & fragmentSource);
+		void StartReload(WatchedProgram & watched);
+		bool FinishReload(WatchedProgram & watched);
+
 	public:
 
-		Shader_Loader(void);
+		Shader_Loader(const char * cacheDirectory = "shader_cache");
 		~Shader_Loader(void);
 		GLuint CreateProgram(char* VertexShaderFilename,
 			char* FragmentShaderFilename);
 
 		void DeleteProgram(GLuint program);
 
+		// Obserwuje pliki shaderow programu (inotify na Linuksie, sprawdzanie co pol sekundy w pozostalych systemach).
+		// O przeladowaniu decyduje zawartosc plikow, nie data modyfikacji.
+		// Po zmianie pliku nowa wersja jest kompilowana w tle, a *program podmieniany dopiero po udanym zlinkowaniu -
+		// przy bledzie w shaderze zostaje stary program.
+		void WatchProgram(GLuint * program, char* vertexShaderFilename, char* fragmentShaderFilename);
+
+		// Wywolywac raz na klatke. Jezeli sterownik obsluguje GL_ARB_parallel_shader_compile, kompilacja idzie na jego
+		// watkach, a jej stan jest odpytywany bez blokowania. Bez tego rozszerzenia stan jest sprawdzany w nastepnej klatce
+		// i sterownik konczy wtedy kompilacje na watku renderowania - ta jedna klatka wydluza sie o czas kompilacji.
+		// Zwraca true, jezeli ktorys program zostal podmieniony (trzeba odswiezyc lokalizacje uniformow).
+		bool UpdateHotReload();
+
+		// laczny czas kompilacji zaoszczedzony dzieki wczytaniu programow z cache
+		double GetSavedMilliseconds() const { return savedMilliseconds; }
+
 	};
 }
\ No newline at end of file
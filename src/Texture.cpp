@@ -1,33 +1,518 @@
 #include "Texture.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <future>
 #include <iterator>
+#include <string>
 #include <vector>
 #include "SOIL/SOIL.h"
+#include "SOIL/image_helper.h"
+extern "C" {
+#include "SOIL/image_DXT.h"
+}
+#include "Logger.h"
 
 typedef unsigned char byte;
 
+namespace
+{
+	const unsigned fourccDDS = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+	const unsigned fourccDXT1 = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('1' << 24);
+	const unsigned fourccDXT5 = ('D' << 0) | ('X' << 8) | ('T' << 16) | ('5' << 24);
+	const unsigned fourccDX10 = ('D' << 0) | ('X' << 8) | ('1' << 16) | ('0' << 24);
+
+	// DDS_HEADER_DXT10, follows the DDS header when its four cc is DX10; arraySize holds the layer count
+	struct DDSHeaderDX10
+	{
+		unsigned dxgiFormat;
+		unsigned resourceDimension;
+		unsigned miscFlag;
+		unsigned arraySize;
+		unsigned miscFlags2;
+	};
+
+	const unsigned dxgiFormatBC1 = 71;	// DXGI_FORMAT_BC1_UNORM
+	const unsigned dxgiFormatBC3 = 77;	// DXGI_FORMAT_BC3_UNORM
+	const unsigned resourceDimensionTexture2D = 3;
+
+	struct DecodedImage
+	{
+		unsigned char * pixels = nullptr;	// RGBA (all layers one after another), or null for compressed images
+		std::vector<unsigned char> compressed;	// mip levels one after another, each level holds all layers
+		std::vector<int> levelSizes;
+		GLenum compressedFormat = 0;
+		int width = 0, height = 0, layers = 1;
+		double decodeTime = 0;
+	};
+
+	struct PendingTexture
+	{
+		GLuint id;
+		GLenum target;
+		std::string filepath;
+		std::future<DecodedImage> image;
+		// texture arrays without a packed file: one decode task per layer, put together on the GL thread
+		std::vector<std::string> layerFiles;
+		int layerSize = 0;
+		std::vector<std::future<DecodedImage> > layers;
+	};
+
+	std::vector<PendingTexture> pendingTextures;
+	GLuint uploadBuffer = 0;
+
+	GLuint CreateTextureObject(GLenum target)
+	{
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(target, id);
+		glTexParameterf(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameterf(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameterf(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameterf(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		return id;
+	}
+
+	std::string DdsPathFor(const std::string & filepath)
+	{
+		size_t dot = filepath.find_last_of('.');
+		return filepath.substr(0, dot) + ".dds";
+	}
+
+	int CompressedLevelSize(int width, int height, GLenum format)
+	{
+		int blockBytes = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+		return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+	}
+
+	bool HasAlpha(const unsigned char * rgba, int numPixels)
+	{
+		for (int i = 0; i < numPixels; i++)
+			if (rgba[i * 4 + 3] != 255) return true;
+		return false;
+	}
+
+	// Box filter resample, good enough both for shrinking photos and for stretching small textures.
+	void ResampleImage(const unsigned char * src, int srcWidth, int srcHeight, unsigned char * dst, int dstWidth, int dstHeight)
+	{
+		for (int y = 0; y < dstHeight; y++)
+		{
+			int y0 = y * srcHeight / dstHeight, y1 = std::max((y + 1) * srcHeight / dstHeight, y0 + 1);
+			for (int x = 0; x < dstWidth; x++)
+			{
+				int x0 = x * srcWidth / dstWidth, x1 = std::max((x + 1) * srcWidth / dstWidth, x0 + 1);
+				unsigned sum[4] = { 0, 0, 0, 0 };
+				for (int sy = y0; sy < y1; sy++)
+					for (int sx = x0; sx < x1; sx++)
+						for (int c = 0; c < 4; c++)
+							sum[c] += src[(sy * srcWidth + sx) * 4 + c];
+				unsigned count = (y1 - y0) * (x1 - x0);
+				for (int c = 0; c < 4; c++)
+					dst[(y * dstWidth + x) * 4 + c] = (unsigned char)(sum[c] / count);
+			}
+		}
+	}
+
+	// Builds the whole mip chain of an RGBA image and compresses every level (DXT5 with alpha, DXT1 otherwise).
+	std::vector<std::vector<unsigned char> > CompressMipChain(const unsigned char * rgba, int width, int height, bool alpha)
+	{
+		std::vector<std::vector<unsigned char> > levels;
+		std::vector<unsigned char> mip;
+		const unsigned char * level = rgba;
+		for (;;)
+		{
+			int size = 0;
+			unsigned char * compressed = alpha
+				? convert_image_to_DXT5(level, width, height, 4, &size)
+				: convert_image_to_DXT1(level, width, height, 4, &size);
+			levels.push_back(std::vector<unsigned char>(compressed, compressed + size));
+			free(compressed);
+
+			if (width == 1 && height == 1) break;
+			int mipWidth = std::max(width / 2, 1), mipHeight = std::max(height / 2, 1);
+			std::vector<unsigned char> next(mipWidth * mipHeight * 4);
+			mipmap_image(level, width, height, 4, &next[0], width > 1 ? 2 : 1, height > 1 ? 2 : 1);
+			mip.swap(next);
+			level = &mip[0];
+			width = mipWidth;
+			height = mipHeight;
+		}
+		return levels;
+	}
+
+	// Texture array as DDS tools expect it: the DX10 header with the layer count in arraySize,
+	// then layer by layer, each with all its mip levels.
+	void CreateDDSHeader(int width, int height, int levels, bool alpha, int layers, DDS_header & header, DDSHeaderDX10 & header10)
+	{
+		memset(&header, 0, sizeof(header));
+		header.dwMagic = fourccDDS;
+		header.dwSize = 124;
+		header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+		header.dwWidth = width;
+		header.dwHeight = height;
+		header.dwPitchOrLinearSize = CompressedLevelSize(width, height, alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT);
+		header.dwMipMapCount = levels;
+		header.sPixelFormat.dwSize = 32;
+		header.sPixelFormat.dwFlags = DDPF_FOURCC;
+		header.sPixelFormat.dwFourCC = fourccDX10;
+		header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+		memset(&header10, 0, sizeof(header10));
+		header10.dxgiFormat = alpha ? dxgiFormatBC3 : dxgiFormatBC1;
+		header10.resourceDimension = resourceDimensionTexture2D;
+		header10.arraySize = layers;
+	}
+
+	// Reads a DXT1/DXT5 DDS file (a texture array with the DX10 header, like the ones from PackTextureArray)
+	// with all its mip levels. The levels are stored one after another, each holding all layers.
+	bool LoadDDS(const std::string & filepath, DecodedImage & result)
+	{
+		std::ifstream file(filepath, std::ios::binary);
+		if (!file.good()) return false;
+
+		DDS_header header;
+		if (!file.read((char *)&header, sizeof(header))) return false;
+		if (header.dwMagic != fourccDDS || !(header.sPixelFormat.dwFlags & DDPF_FOURCC))
+			return false;
+
+		unsigned format = header.sPixelFormat.dwFourCC;
+		result.layers = 1;
+		if (format == fourccDX10)
+		{
+			DDSHeaderDX10 header10;
+			if (!file.read((char *)&header10, sizeof(header10)) || header10.resourceDimension != resourceDimensionTexture2D
+				|| header10.arraySize == 0 || header10.arraySize > 2048)
+				return false;
+			format = header10.dxgiFormat == dxgiFormatBC1 ? fourccDXT1 : header10.dxgiFormat == dxgiFormatBC3 ? fourccDXT5 : 0;
+			result.layers = header10.arraySize;
+		}
+		if (format == fourccDXT1)
+			result.compressedFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		else if (format == fourccDXT5)
+			result.compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		else
+			return false;
+
+		result.width = header.dwWidth;
+		result.height = header.dwHeight;
+		int levels = (header.dwFlags & DDSD_MIPMAPCOUNT) && header.dwMipMapCount > 0 ? header.dwMipMapCount : 1;
+		std::vector<int> levelOffsets;
+		int totalSize = 0;
+		for (int i = 0, w = result.width, h = result.height; i < levels; i++, w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+		{
+			levelOffsets.push_back(totalSize);
+			result.levelSizes.push_back(CompressedLevelSize(w, h, result.compressedFormat) * result.layers);
+			totalSize += result.levelSizes.back();
+		}
+		result.compressed.resize(totalSize);
+		for (int layer = 0; layer < result.layers; layer++)
+			for (int i = 0; i < levels; i++)
+			{
+				int layerSize = result.levelSizes[i] / result.layers;
+				if (!file.read((char *)&result.compressed[levelOffsets[i] + layer * layerSize], layerSize)) return false;
+			}
+		return true;
+	}
+
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	DecodedImage DecodeImage(std::string filepath, bool allowCompressed)
+	{
+		auto start = std::chrono::steady_clock::now();
+		DecodedImage result;
+		if (!allowCompressed || !LoadDDS(DdsPathFor(filepath), result))
+		{
+			result = DecodedImage();
+			result.pixels = SOIL_load_image(filepath.c_str(), &result.width, &result.height, 0, SOIL_LOAD_RGBA);
+		}
+		result.decodeTime = MillisecondsSince(start);
+		return result;
+	}
+
+	// Decodes one source image and stretches it to a layerSize x layerSize layer, or leaves the pixels null.
+	// Pixels are allocated with malloc, so SOIL_free_image_data() can release them like any other image.
+	DecodedImage DecodeLayer(std::string filepath, int layerSize)
+	{
+		auto start = std::chrono::steady_clock::now();
+		DecodedImage result;
+		result.width = result.height = layerSize;
+		int w, h;
+		unsigned char * image = SOIL_load_image(filepath.c_str(), &w, &h, 0, SOIL_LOAD_RGBA);
+		if (image)
+		{
+			result.pixels = (unsigned char *)malloc((size_t)layerSize * layerSize * 4);
+			ResampleImage(image, w, h, result.pixels, layerSize, layerSize);
+			SOIL_free_image_data(image);
+		}
+		result.decodeTime = MillisecondsSince(start);
+		return result;
+	}
+
+	std::vector<std::future<DecodedImage> > DecodeLayersAsync(const std::vector<std::string> & filepaths, int layerSize)
+	{
+		std::vector<std::future<DecodedImage> > layers;
+		for (const std::string & filepath : filepaths)
+			layers.push_back(std::async(std::launch::async, DecodeLayer, filepath, layerSize));
+		return layers;
+	}
+
+	// Puts the decoded layers into one RGBA array, a layer that failed to load is white.
+	DecodedImage AssembleLayers(const std::vector<std::string> & filepaths, int layerSize, std::vector<std::future<DecodedImage> > & layers)
+	{
+		DecodedImage result;
+		result.width = result.height = layerSize;
+		result.layers = (int)layers.size();
+		size_t layerBytes = (size_t)layerSize * layerSize * 4;
+		result.pixels = (unsigned char *)malloc(layerBytes * layers.size());
+		for (size_t i = 0; i < layers.size(); i++)
+		{
+			DecodedImage layer = layers[i].get();
+			result.decodeTime = std::max(result.decodeTime, layer.decodeTime);
+			if (!layer.pixels)
+			{
+				// SOIL_last_result() is one global for all the decode tasks, it may describe another file by now
+				Core::Log(Core::LogLevel::Error, "can't load texture %s: missing or not a supported image", filepaths[i].c_str());
+				memset(result.pixels + i * layerBytes, 255, layerBytes);
+				continue;
+			}
+			memcpy(result.pixels + i * layerBytes, layer.pixels, layerBytes);
+			SOIL_free_image_data(layer.pixels);
+		}
+		return result;
+	}
+
+	bool LayersReady(const std::vector<std::future<DecodedImage> > & layers)
+	{
+		for (const auto & layer : layers)
+			if (layer.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+		return true;
+	}
+
+	// The packed array only, the layers are decoded separately when there is none.
+	DecodedImage LoadPackedArray(std::string packedPath, int numLayers, bool allowCompressed)
+	{
+		auto start = std::chrono::steady_clock::now();
+		DecodedImage result;
+		if (!allowCompressed || !LoadDDS(packedPath, result) || result.layers != numLayers)
+			result = DecodedImage();
+		result.decodeTime = MillisecondsSince(start);
+		return result;
+	}
+
+	bool CompressedTexturesSupported()
+	{
+		return GLEW_EXT_texture_compression_s3tc != 0;
+	}
+
+	void UploadCompressed(GLenum target, GLuint id, const DecodedImage & image)
+	{
+		GLsizeiptr size = (GLsizeiptr)image.compressed.size();
+		if (!uploadBuffer)
+			glGenBuffers(1, &uploadBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, &image.compressed[0], GL_STREAM_DRAW);
+
+		// the mip chain is prebuilt, so no glGenerateMipmap here
+		glBindTexture(target, id);
+		const char * offset = 0;
+		int w = image.width, h = image.height;
+		for (int level = 0; level < (int)image.levelSizes.size(); level++)
+		{
+			if (target == GL_TEXTURE_2D_ARRAY)
+				glCompressedTexImage3D(target, level, image.compressedFormat, w, h, image.layers, 0, image.levelSizes[level], offset);
+			else
+				glCompressedTexImage2D(target, level, image.compressedFormat, w, h, 0, image.levelSizes[level], offset);
+			offset += image.levelSizes[level];
+			w = std::max(w / 2, 1);
+			h = std::max(h / 2, 1);
+		}
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)image.levelSizes.size() - 1);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	void UploadPixels(GLenum target, const DecodedImage & image, const void * pixels)
+	{
+		if (target == GL_TEXTURE_2D_ARRAY)
+			glTexImage3D(target, 0, GL_RGBA8, image.width, image.height, image.layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		else
+			glTexImage2D(target, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	}
+
+	void UploadThroughPixelBuffer(GLenum target, GLuint id, const DecodedImage & image)
+	{
+		if (!image.compressed.empty())
+		{
+			UploadCompressed(target, id, image);
+			return;
+		}
+
+		GLsizeiptr size = (GLsizeiptr)image.width * image.height * image.layers * 4;
+		if (!uploadBuffer)
+			glGenBuffers(1, &uploadBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		void * mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mapped)
+		{
+			memcpy(mapped, image.pixels, size);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+
+		glBindTexture(target, id);
+		if (mapped)
+			UploadPixels(target, image, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		if (!mapped)
+			UploadPixels(target, image, image.pixels);
+		glGenerateMipmap(target);
+	}
+
+	void QueueDecode(GLuint id, GLenum target, const std::string & name, std::future<DecodedImage> image)
+	{
+		PendingTexture pending;
+		pending.id = id;
+		pending.target = target;
+		pending.filepath = name;
+		pending.image = std::move(image);
+		pendingTextures.push_back(std::move(pending));
+	}
+}
+
 GLuint Core::LoadTexture( const char * filepath )
 {
-	GLuint id;
-	glGenTextures(1, &id);
-	glBindTexture(GL_TEXTURE_2D, id);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	int w, h;
-	unsigned char* image = SOIL_load_image(filepath, &w, &h, 0, SOIL_LOAD_RGBA);
-	
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+	GLuint id = CreateTextureObject(GL_TEXTURE_2D);
+
+	DecodedImage image = DecodeImage(filepath, CompressedTexturesSupported());
+	if (!image.compressed.empty())
+	{
+		UploadCompressed(GL_TEXTURE_2D, id, image);
+		return id;
+	}
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
 	glGenerateMipmap(GL_TEXTURE_2D);
-	SOIL_free_image_data(image);
+	SOIL_free_image_data(image.pixels);
 
 	return id;
 }
 
+GLuint Core::LoadTextureArrayAsync(const char * const * filepaths, int numLayers, int layerSize, const char * packedPath)
+{
+	GLuint id = CreateTextureObject(GL_TEXTURE_2D_ARRAY);
+
+	std::vector<byte> placeholder(numLayers * 4, 128);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, 1, 1, numLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, &placeholder[0]);
+
+	QueueDecode(id, GL_TEXTURE_2D_ARRAY, packedPath,
+		std::async(std::launch::async, LoadPackedArray, std::string(packedPath), numLayers, CompressedTexturesSupported()));
+	pendingTextures.back().layerFiles.assign(filepaths, filepaths + numLayers);
+	pendingTextures.back().layerSize = layerSize;
+	return id;
+}
+
+int Core::UpdateTextureStreaming(int maxUploads)
+{
+	for (size_t i = 0; i < pendingTextures.size() && maxUploads > 0;)
+	{
+		PendingTexture & pending = pendingTextures[i];
+		DecodedImage image;
+		if (!pending.layers.empty())
+		{
+			if (!LayersReady(pending.layers))
+			{
+				i++;
+				continue;
+			}
+			image = AssembleLayers(pending.layerFiles, pending.layerSize, pending.layers);
+		}
+		else
+		{
+			if (pending.image.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				i++;
+				continue;
+			}
+			image = pending.image.get();
+			if (image.compressed.empty() && !pending.layerFiles.empty())
+			{
+				// no packed array, every layer is decoded on its own thread
+				pending.layers = DecodeLayersAsync(pending.layerFiles, pending.layerSize);
+				i++;
+				continue;
+			}
+		}
+		if (!image.compressed.empty())
+		{
+			UploadThroughPixelBuffer(pending.target, pending.id, image);
+			Log(LogLevel::Info, "texture %s: %dx%dx%d, %d compressed levels (%d KB) read in %.1f ms", pending.filepath.c_str(),
+				image.width, image.height, image.layers, (int)image.levelSizes.size(), (int)image.compressed.size() / 1024, image.decodeTime);
+		}
+		else if (image.pixels)
+		{
+			UploadThroughPixelBuffer(pending.target, pending.id, image);
+			SOIL_free_image_data(image.pixels);
+			Log(LogLevel::Info, "texture %s: %dx%dx%d decoded in %.1f ms", pending.filepath.c_str(),
+				image.width, image.height, image.layers, image.decodeTime);
+		}
+		else
+			Log(LogLevel::Error, "can't load texture %s", pending.filepath.c_str());
+
+		pendingTextures.erase(pendingTextures.begin() + i);
+		maxUploads--;
+	}
+
+	if (pendingTextures.empty() && uploadBuffer)
+	{
+		glDeleteBuffers(1, &uploadBuffer);
+		uploadBuffer = 0;
+	}
+	return (int)pendingTextures.size();
+}
+
+bool Core::PackTextureArray(const char * const * filepaths, int numLayers, int layerSize, const char * packedPath)
+{
+	std::vector<std::string> files(filepaths, filepaths + numLayers);
+	std::vector<std::future<DecodedImage> > decoded = DecodeLayersAsync(files, layerSize);
+	unsigned char * pixels = AssembleLayers(files, layerSize, decoded).pixels;
+	size_t layerBytes = (size_t)layerSize * layerSize * 4;
+
+	// one format for the whole array, so a single translucent layer switches all of them to BC3
+	bool alpha = HasAlpha(pixels, layerSize * layerSize * numLayers);
+	std::vector<std::vector<std::vector<unsigned char> > > layers;
+	for (int i = 0; i < numLayers; i++)
+		layers.push_back(CompressMipChain(pixels + i * layerBytes, layerSize, layerSize, alpha));
+	SOIL_free_image_data(pixels);
+
+	int numLevels = (int)layers[0].size();
+	DDS_header header;
+	DDSHeaderDX10 header10;
+	CreateDDSHeader(layerSize, layerSize, numLevels, alpha, numLayers, header, header10);
+	std::ofstream out(packedPath, std::ios::binary);
+	out.write((const char *)&header, sizeof(header));
+	out.write((const char *)&header10, sizeof(header10));
+	size_t totalSize = 0;
+	for (int i = 0; i < numLayers; i++)
+		for (int level = 0; level < numLevels; level++)
+		{
+			out.write((const char *)&layers[i][level][0], layers[i][level].size());
+			totalSize += layers[i][level].size();
+		}
+	if (!out.good())
+	{
+		Log(LogLevel::Error, "can't write %s", packedPath);
+		return false;
+	}
+	Log(LogLevel::Info, "packed %d textures into %s: %dx%d %s, %d levels, %d KB", numLayers, packedPath, layerSize, layerSize,
+		alpha ? "BC3" : "BC1", numLevels, (int)totalSize / 1024);
+	return true;
+}
+
 void Core::SetActiveTexture(GLuint textureID, const char * shaderVariableName, GLuint programID, int textureUnit)
 {
 	glUniform1i(glGetUniformLocation(programID, shaderVariableName), textureUnit);
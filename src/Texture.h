@@ -5,11 +5,28 @@
 
 namespace Core
 {
+	// Jesli obok pliku istnieje wersja skompresowana DXT1/DXT5 (ta sama nazwa, rozszerzenie .dds) z gotowymi mipmapami,
+	// a karta obsluguje kompresje S3TC, wczytywana jest ona zamiast oryginalu.
 	GLuint LoadTexture(const char * filepath);
 
+	// Laduje kilka obrazow jako warstwy jednej tekstury GL_TEXTURE_2D_ARRAY o rozmiarze layerSize x layerSize
+	// (warstwa i = filepaths[i]). Jesli istnieje plik packedPath z PackTextureArray, wczytywane sa gotowe skompresowane warstwy.
+	// Tekstura jest dostepna od razu (z szarymi warstwami 1x1 jako zastepstwem), obrazy sa dekodowane w tle, kazdy na osobnym watku,
+	// i trafiaja do tej samej tekstury w UpdateTextureStreaming().
+	GLuint LoadTextureArrayAsync(const char * const * filepaths, int numLayers, int layerSize, const char * packedPath);
+
+	// Wysyla zdekodowane obrazy na karte graficzna przez pixel buffer object.
+	// Wywolywac raz na klatke z watku OpenGL; maxUploads ogranicza liczbe tekstur wyslanych w jednej klatce.
+	// Zwraca liczbe tekstur, ktore jeszcze nie zostaly wczytane.
+	int UpdateTextureStreaming(int maxUploads = 1);
+
+	// Konwersja offline dla LoadTextureArrayAsync: skaluje obrazy do layerSize x layerSize, kompresuje wszystkie mipmapy
+	// i zapisuje je do jednego pliku packedPath.
+	bool PackTextureArray(const char * const * filepaths, int numLayers, int layerSize, const char * packedPath);
+
 	// textureID - identyfikator tekstury otrzymany z funkcji LoadTexture
 	// shaderVariableName - nazwa zmiennej typu 'sampler2D' w shaderze, z ktora ma zostac powiazana tekstura
 	// programID - identyfikator aktualnego programu karty graficznej
 	// textureUnit - indeks jednostki teksturujacej - liczba od 0 do 7. Jezeli uzywa sie wielu tekstur w jednym shaderze, to kazda z nich nalezy powiazac z inna jednostka.
 	void SetActiveTexture(GLuint textureID, const char * shaderVariableName, GLuint programID, int textureUnit);
-}
\ No newline at end of file
+}
@@ -0,0 +1,491 @@
+#include "Throw_Replay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "gtc/quaternion.hpp"
+#include "Logger.h"
+#include "Ring_Buffer.h"
+
+namespace
+{
+	using Core::QuantizedPose;
+	using Core::ThrowReplay;
+
+	// file layout: header, the keyframe offsets, then the stream
+	// stream: per sample either a keyframe (every recorded track as 3 int32 position and 4 int16
+	// rotation values) or a delta: varint mask of the tracks that moved, varint mask of those that
+	// moved exactly as predicted, then for the others 7 zigzag varints of the quantized pose minus
+	// the prediction (the last pose plus the step between the last two)
+	struct ReplayHeader
+	{
+		unsigned magic;
+		unsigned version;
+		int numTracks;
+		unsigned trackMask;
+		int numSamples;
+		int keyframeInterval;
+		float sampleTime;
+		unsigned numKeyframes;
+		unsigned streamSize;
+	};
+
+	const unsigned replayMagic = ('B' << 0) | ('T' << 8) | ('R' << 16) | ('P' << 24);
+	const unsigned replayVersion = 1;
+	// quantization steps: 1/1024 m for positions, 1/32767 for quaternion components
+	const float positionScale = 1024.0f;
+	const float rotationScale = 32767.0f;
+
+	void MakeDirectory(const std::string & path)
+	{
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	void WriteFixed(std::vector<unsigned char> & stream, unsigned value, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+			stream.push_back((unsigned char)(value >> (8 * i)));
+	}
+
+	void WriteVarint(std::vector<unsigned char> & stream, unsigned value)
+	{
+		while (value >= 0x80)
+		{
+			stream.push_back((unsigned char)(value | 0x80));
+			value >>= 7;
+		}
+		stream.push_back((unsigned char)value);
+	}
+
+	void WriteSigned(std::vector<unsigned char> & stream, int value)
+	{
+		WriteVarint(stream, ((unsigned)value << 1) ^ (unsigned)(value >> 31));
+	}
+
+	// reads advance offset and fail instead of reading past the end of a damaged stream
+	bool ReadFixed(const std::vector<unsigned char> & stream, size_t & offset, int bytes, unsigned & value)
+	{
+		if (offset + bytes > stream.size()) return false;
+		value = 0;
+		for (int i = 0; i < bytes; i++)
+			value |= (unsigned)stream[offset++] << (8 * i);
+		return true;
+	}
+
+	bool ReadVarint(const std::vector<unsigned char> & stream, size_t & offset, unsigned & value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 35 && offset < stream.size(); shift += 7)
+		{
+			unsigned char byte = stream[offset++];
+			value |= (unsigned)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return true;
+		}
+		return false;
+	}
+
+	bool ReadSigned(const std::vector<unsigned char> & stream, size_t & offset, int & value)
+	{
+		unsigned zigzag;
+		if (!ReadVarint(stream, offset, zigzag)) return false;
+		value = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+		return true;
+	}
+
+	int * Components(QuantizedPose & pose, int i)
+	{
+		return i < 3 ? &pose.position[i] : &pose.rotation[i - 3];
+	}
+
+	bool SamePose(const QuantizedPose & a, const QuantizedPose & b)
+	{
+		return std::equal(a.position, a.position + 3, b.position) && std::equal(a.rotation, a.rotation + 4, b.rotation);
+	}
+
+	QuantizedPose Predict(const QuantizedPose & last, const QuantizedPose & beforeLast)
+	{
+		QuantizedPose predicted;
+		for (int i = 0; i < 3; i++)
+			predicted.position[i] = 2 * last.position[i] - beforeLast.position[i];
+		for (int i = 0; i < 4; i++)
+			predicted.rotation[i] = std::max(-32767, std::min(32767, 2 * last.rotation[i] - beforeLast.rotation[i]));
+		return predicted;
+	}
+
+	// q and -q are the same rotation, the one closer to the last sample keeps the deltas small
+	QuantizedPose Quantize(const Core::RigidPose & pose, const QuantizedPose & last)
+	{
+		float q[4] = { pose.qx, pose.qy, pose.qz, pose.qw };
+		long long dot = 0;
+		for (int i = 0; i < 4; i++)
+			dot += (long long)(q[i] * rotationScale) * last.rotation[i];
+		float sign = dot < 0 ? -1.0f : 1.0f;
+
+		QuantizedPose quantized;
+		quantized.position[0] = (int)lroundf(pose.px * positionScale);
+		quantized.position[1] = (int)lroundf(pose.py * positionScale);
+		quantized.position[2] = (int)lroundf(pose.pz * positionScale);
+		for (int i = 0; i < 4; i++)
+			quantized.rotation[i] = std::max(-32767, std::min(32767, (int)lroundf(sign * q[i] * rotationScale)));
+		return quantized;
+	}
+
+	struct PendingReplay
+	{
+		ThrowReplay replay;
+		std::string directory;
+		std::string name;
+	};
+
+	// the replays travel through the queue as pointers, so a push never copies or allocates
+	class ReplayWriter
+	{
+	public:
+		ReplayWriter() : running(false) {}
+		~ReplayWriter() { Stop(); }
+
+		void Start()
+		{
+			if (running.exchange(true)) return;
+			worker = std::thread(&ReplayWriter::Run, this);
+		}
+
+		void Stop()
+		{
+			if (!running.exchange(false)) return;
+			worker.join();
+			Write();
+		}
+
+		void Run()
+		{
+			while (running.load(std::memory_order_relaxed))
+			{
+				if (!Write())
+					std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			}
+		}
+
+		bool Write()
+		{
+			PendingReplay * pending;
+			bool any = false;
+			while (queue.Pop(pending))
+			{
+				if (Core::SaveThrowReplay(pending->replay, pending->directory.c_str(), pending->name.c_str()))
+					Core::Log(Core::LogLevel::Debug, "replay %s: %d samples, %zu bytes", pending->name.c_str(), pending->replay.numSamples, pending->replay.stream.size());
+				delete pending;
+				any = true;
+			}
+			return any;
+		}
+
+		Core::RingBuffer<PendingReplay *, 64> queue;
+		std::thread worker;
+		std::atomic<bool> running;
+	};
+
+	ReplayWriter writer;
+
+	Core::RigidPose Dequantize(const QuantizedPose & from, const QuantizedPose & to, float alpha)
+	{
+		glm::vec3 a(from.position[0], from.position[1], from.position[2]);
+		glm::vec3 b(to.position[0], to.position[1], to.position[2]);
+		glm::vec3 position = glm::mix(a, b, alpha) / positionScale;
+		glm::quat qa = glm::normalize(glm::quat((float)from.rotation[3], (float)from.rotation[0], (float)from.rotation[1], (float)from.rotation[2]));
+		glm::quat qb = glm::normalize(glm::quat((float)to.rotation[3], (float)to.rotation[0], (float)to.rotation[1], (float)to.rotation[2]));
+		glm::quat rotation = glm::slerp(qa, qb, alpha);
+		return { rotation.x, rotation.y, rotation.z, rotation.w, position.x, position.y, position.z };
+	}
+}
+
+void Core::ReplayRecorder::Begin(int numTracks, unsigned trackMask, float sampleTime, int keyframeInterval)
+{
+	replay = ThrowReplay();
+	replay.numTracks = std::min(numTracks, (int)ThrowReplay::maxTracks);
+	replay.trackMask = trackMask & ((1u << replay.numTracks) - 1);
+	replay.sampleTime = sampleTime;
+	replay.numSamples = 0;
+	replay.keyframeInterval = std::max(1, keyframeInterval);
+	for (int t = 0; t < ThrowReplay::maxTracks; t++)
+		last[t] = beforeLast[t] = { { 0, 0, 0 }, { 0, 0, 0, 32767 } };
+	recording = true;
+}
+
+void Core::ReplayRecorder::AddSample(const RigidPose * poses)
+{
+	if (!recording) return;
+	bool keyframe = replay.numSamples % replay.keyframeInterval == 0;
+	replay.numSamples++;
+
+	if (keyframe)
+	{
+		replay.keyframes.push_back((unsigned)replay.stream.size());
+		for (int t = 0; t < replay.numTracks; t++)
+		{
+			if (!(replay.trackMask & (1u << t))) continue;
+			// a keyframe starts without motion, seeking to it must not need the samples before
+			last[t] = beforeLast[t] = Quantize(poses[t], last[t]);
+			for (int i = 0; i < 3; i++)
+				WriteFixed(replay.stream, (unsigned)last[t].position[i], 4);
+			for (int i = 0; i < 4; i++)
+				WriteFixed(replay.stream, (unsigned)last[t].rotation[i], 2);
+		}
+		return;
+	}
+
+	QuantizedPose quantized[ThrowReplay::maxTracks], predicted[ThrowReplay::maxTracks];
+	unsigned moved = 0, asPredicted = 0;
+	for (int t = 0; t < replay.numTracks; t++)
+	{
+		if (!(replay.trackMask & (1u << t))) continue;
+		quantized[t] = Quantize(poses[t], last[t]);
+		predicted[t] = Predict(last[t], beforeLast[t]);
+		if (SamePose(quantized[t], last[t])) continue;
+		moved |= 1u << t;
+		if (SamePose(quantized[t], predicted[t]))
+			asPredicted |= 1u << t;
+	}
+	WriteVarint(replay.stream, moved);
+	if (moved)
+		WriteVarint(replay.stream, asPredicted);
+	for (int t = 0; t < replay.numTracks; t++)
+	{
+		if (!(replay.trackMask & (1u << t))) continue;
+		if ((moved & ~asPredicted) & (1u << t))
+		{
+			for (int i = 0; i < 7; i++)
+				WriteSigned(replay.stream, *Components(quantized[t], i) - *Components(predicted[t], i));
+		}
+		beforeLast[t] = last[t];
+		last[t] = (moved & (1u << t)) ? quantized[t] : last[t];
+	}
+}
+
+void Core::ReplayRecorder::Finish(ThrowReplay & finished)
+{
+	finished = replay;
+	Discard();
+}
+
+void Core::ReplayRecorder::Discard()
+{
+	replay = ThrowReplay();
+	replay.numSamples = 0;
+	recording = false;
+}
+
+bool Core::ReplayPlayer::Open(const ThrowReplay & replayToPlay)
+{
+	replay = &replayToPlay;
+	sample = -1;
+	offset = 0;
+	lastValid = previousValid = false;
+	return replay->numSamples > 0 && !replay->keyframes.empty();
+}
+
+float Core::ReplayPlayer::GetDuration() const
+{
+	return replay ? std::max(0, replay->numSamples - 1) * replay->sampleTime : 0.0f;
+}
+
+void Core::ReplayPlayer::Sample(float time, RigidPose * poses)
+{
+	if (!replay || replay->numSamples == 0) return;
+	float position = glm::clamp(time / replay->sampleTime, 0.0f, (float)(replay->numSamples - 1));
+	int first = (int)position;
+	int second = std::min(first + 1, replay->numSamples - 1);
+	float alpha = position - first;
+
+	// the pair of samples is usually still decoded from the last frame, or one sample further
+	if (sample != second || !previousValid)
+	{
+		if (!Seek(first)) return;
+		if (second != first && !Seek(second)) return;
+	}
+	const QuantizedPose * from = second != first ? previous : last;
+	for (int t = 0; t < replay->numTracks; t++)
+	{
+		if (replay->trackMask & (1u << t))
+			poses[t] = Dequantize(from[t], last[t], alpha);
+	}
+}
+
+bool Core::ReplayPlayer::Seek(int target)
+{
+	int interval = replay->keyframeInterval;
+	// the next sample is decoded even across a keyframe, so the one before stays for blending
+	bool jump = target < sample || sample < 0 || (target > sample + 1 && target / interval > sample / interval);
+	if (jump)
+	{
+		int keyframe = target / interval;
+		if (keyframe >= (int)replay->keyframes.size()) return false;
+		sample = keyframe * interval - 1;
+		offset = replay->keyframes[keyframe];
+		// nothing was decoded at the sample before the keyframe
+		lastValid = false;
+	}
+	while (sample < target)
+	{
+		if (!DecodeNext())
+		{
+			Log(LogLevel::Error, "replay: the stream is damaged at sample %d", sample + 1);
+			sample = -1;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Core::ReplayPlayer::DecodeNext()
+{
+	const std::vector<unsigned char> & stream = replay->stream;
+	int next = sample + 1;
+	std::copy(last, last + replay->numTracks, previous);
+	previousValid = lastValid;
+	if (next % replay->keyframeInterval == 0)
+	{
+		for (int t = 0; t < replay->numTracks; t++)
+		{
+			if (!(replay->trackMask & (1u << t))) continue;
+			unsigned value;
+			for (int i = 0; i < 3; i++)
+			{
+				if (!ReadFixed(stream, offset, 4, value)) return false;
+				last[t].position[i] = (int)value;
+			}
+			for (int i = 0; i < 4; i++)
+			{
+				if (!ReadFixed(stream, offset, 2, value)) return false;
+				last[t].rotation[i] = (short)value;
+			}
+			beforeLast[t] = last[t];
+		}
+		sample = next;
+		lastValid = true;
+		return true;
+	}
+
+	unsigned moved, asPredicted = 0;
+	if (!ReadVarint(stream, offset, moved) || (moved && !ReadVarint(stream, offset, asPredicted)))
+		return false;
+	for (int t = 0; t < replay->numTracks; t++)
+	{
+		if (!(replay->trackMask & (1u << t))) continue;
+		QuantizedPose current = last[t];
+		if (moved & (1u << t))
+		{
+			current = Predict(last[t], beforeLast[t]);
+			if (!(asPredicted & (1u << t)))
+			{
+				for (int i = 0; i < 7; i++)
+				{
+					int residual;
+					if (!ReadSigned(stream, offset, residual)) return false;
+					*Components(current, i) += residual;
+				}
+			}
+		}
+		beforeLast[t] = last[t];
+		last[t] = current;
+	}
+	sample = next;
+	lastValid = true;
+	return true;
+}
+
+bool Core::SaveThrowReplay(const ThrowReplay & replay, const char * directory, const char * name)
+{
+	MakeDirectory(directory);
+	std::string path = std::string(directory) + "/" + name;
+	FILE * file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		Log(LogLevel::Error, "replay: can't write %s", path.c_str());
+		return false;
+	}
+	ReplayHeader header = { replayMagic, replayVersion, replay.numTracks, replay.trackMask, replay.numSamples,
+		replay.keyframeInterval, replay.sampleTime, (unsigned)replay.keyframes.size(), (unsigned)replay.stream.size() };
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& (replay.keyframes.empty() || fwrite(&replay.keyframes[0], sizeof(unsigned), replay.keyframes.size(), file) == replay.keyframes.size())
+		&& (replay.stream.empty() || fwrite(&replay.stream[0], 1, replay.stream.size(), file) == replay.stream.size());
+	written = fclose(file) == 0 && written;
+	if (!written)
+		Log(LogLevel::Error, "replay: can't write %s", path.c_str());
+	return written;
+}
+
+bool Core::LoadThrowReplay(ThrowReplay & replay, const char * filepath)
+{
+	FILE * file = fopen(filepath, "rb");
+	if (!file)
+	{
+		Log(LogLevel::Error, "replay: can't open %s", filepath);
+		return false;
+	}
+	ReplayHeader header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == replayMagic && header.version == replayVersion
+		&& header.numTracks > 0 && header.numTracks <= ThrowReplay::maxTracks && header.numSamples > 0
+		&& header.keyframeInterval > 0 && header.sampleTime > 0.0f
+		&& header.numKeyframes == (unsigned)((header.numSamples + header.keyframeInterval - 1) / header.keyframeInterval);
+	if (valid)
+	{
+		// the sizes are checked against the file before anything is allocated, a corrupt header could ask for gigabytes
+		long start = ftell(file);
+		fseek(file, 0, SEEK_END);
+		long long remaining = (long long)ftell(file) - start;
+		fseek(file, start, SEEK_SET);
+		valid = (long long)header.numKeyframes * sizeof(unsigned) + header.streamSize == remaining;
+	}
+	if (valid)
+	{
+		replay.numTracks = header.numTracks;
+		replay.trackMask = header.trackMask;
+		replay.numSamples = header.numSamples;
+		replay.keyframeInterval = header.keyframeInterval;
+		replay.sampleTime = header.sampleTime;
+		replay.keyframes.resize(header.numKeyframes);
+		replay.stream.resize(header.streamSize);
+		valid = fread(&replay.keyframes[0], sizeof(unsigned), header.numKeyframes, file) == header.numKeyframes
+			&& (header.streamSize == 0 || fread(&replay.stream[0], 1, header.streamSize, file) == header.streamSize);
+		for (unsigned keyframe : replay.keyframes)
+			valid = valid && keyframe <= header.streamSize;
+	}
+	fclose(file);
+	if (!valid)
+		Log(LogLevel::Error, "replay: %s is not a throw replay of this version", filepath);
+	return valid;
+}
+
+void Core::StartReplayWriter()
+{
+	writer.Start();
+}
+
+void Core::StopReplayWriter()
+{
+	writer.Stop();
+}
+
+bool Core::QueueThrowReplay(ThrowReplay && replay, const char * directory, const char * name)
+{
+	if (!writer.running.load(std::memory_order_relaxed)) return false;
+	PendingReplay * pending = new PendingReplay{ std::move(replay), directory, name };
+	if (writer.queue.Push(pending)) return true;
+	Log(LogLevel::Warning, "replay: queue full, %s not saved", name);
+	delete pending;
+	return false;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+
+#include "Transform_Batch.h"
+
+namespace Core
+{
+	// One recorded throw: the poses of the ball and the pins (the tracks) at a fixed rate, stored
+	// as a keyframe every keyframeInterval samples and quantized deltas in between (about 1 mm and
+	// 1/32767 of a quaternion component). Bodies that don't move between two samples, standing or
+	// sleeping, take no bytes at all.
+	struct ThrowReplay
+	{
+		static const int maxTracks = 16;
+
+		float sampleTime;
+		int numSamples;
+		int numTracks;
+		// bit t is set for the recorded tracks, the pins missing from a rack are left out
+		unsigned trackMask;
+		int keyframeInterval;
+		// offset of every keyframe in the stream, for seeking
+		std::vector<unsigned> keyframes;
+		std::vector<unsigned char> stream;
+	};
+
+	// Pose in the integer units of the replay stream.
+	struct QuantizedPose
+	{
+		int position[3];
+		int rotation[4];
+	};
+
+	// Encodes a throw sample by sample while it is being simulated.
+	class ReplayRecorder
+	{
+	public:
+		ReplayRecorder() : recording(false) {}
+
+		void Begin(int numTracks, unsigned trackMask, float sampleTime, int keyframeInterval = 120);
+		// poses[t] for every track, the ones not in the mask are ignored
+		void AddSample(const RigidPose * poses);
+		// Hands the recording over, the recorder is idle afterwards.
+		void Finish(ThrowReplay & replay);
+		void Discard();
+		bool IsRecording() const { return recording; }
+		int GetNumSamples() const { return replay.numSamples; }
+
+	private:
+		ThrowReplay replay;
+		// the last two samples, the deltas are taken against the motion they predict
+		QuantizedPose last[ThrowReplay::maxTracks];
+		QuantizedPose beforeLast[ThrowReplay::maxTracks];
+		bool recording;
+	};
+
+	// Decodes poses of a replay at any time. Playing forward only decodes the new samples,
+	// going back (or far ahead) starts again from the nearest keyframe.
+	class ReplayPlayer
+	{
+	public:
+		ReplayPlayer() : replay(nullptr), sample(-1), offset(0), lastValid(false), previousValid(false) {}
+
+		// The replay has to outlive the player. Returns false if it has no samples.
+		bool Open(const ThrowReplay & replay);
+		float GetDuration() const;
+
+		// Poses at time seconds from the start of the throw (clamped to the replay), blended
+		// between the two samples around it. Only the tracks in the mask are written.
+		void Sample(float time, RigidPose * poses);
+
+	private:
+		bool Seek(int target);
+		bool DecodeNext();
+
+		const ThrowReplay * replay;
+		// the sample decoded last and where the next one starts in the stream
+		int sample;
+		size_t offset;
+		QuantizedPose last[ThrowReplay::maxTracks];
+		QuantizedPose beforeLast[ThrowReplay::maxTracks];
+		// poses of the sample before, for blending
+		QuantizedPose previous[ThrowReplay::maxTracks];
+		// whether last and previous hold decoded samples, not after jumping to a keyframe
+		bool lastValid;
+		bool previousValid;
+	};
+
+	// Writes the replay to directory/name, creating the directory if needed.
+	bool SaveThrowReplay(const ThrowReplay & replay, const char * directory, const char * name);
+
+	bool LoadThrowReplay(ThrowReplay & replay, const char * filepath);
+
+	// Starts the thread which saves the replays queued with QueueThrowReplay.
+	void StartReplayWriter();
+
+	// Saves what is left in the queue and joins the writer thread.
+	void StopReplayWriter();
+
+	// Hands the replay over to the writer thread, which saves it like SaveThrowReplay. Never blocks
+	// and never touches the disk; returns false if the writer is not started or its queue is full.
+	bool QueueThrowReplay(ThrowReplay && replay, const char * directory, const char * name);
+}
@@ -0,0 +1,93 @@
+#include "Transform_Batch.h"
+
+#include <algorithm>
+#include <xmmintrin.h>
+
+using namespace Core;
+
+namespace
+{
+	// a * b for one column b, with the columns of a in a0..a3
+	inline __m128 TransformColumn(__m128 a0, __m128 a1, __m128 a2, __m128 a3, __m128 b)
+	{
+		__m128 result = _mm_mul_ps(a0, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)));
+		result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+		result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2))));
+		return _mm_add_ps(result, _mm_mul_ps(a3, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3))));
+	}
+}
+
+TransformBatch::TransformBatch()
+	: count(0), capacity(0), buffer(nullptr), models(nullptr), mvps(nullptr)
+{
+}
+
+TransformBatch::~TransformBatch()
+{
+	_mm_free(buffer);
+}
+
+void TransformBatch::Reserve(int count)
+{
+	if (count <= capacity) return;
+	_mm_free(buffer);
+	capacity = std::max(count, capacity * 2);
+	buffer = (float *)_mm_malloc(capacity * 2 * 16 * sizeof(float), 16);
+	models = buffer;
+	mvps = buffer + capacity * 16;
+}
+
+void TransformBatch::Compose(int count, const RigidPose * poses, const glm::mat4 * localTransforms, const glm::mat4 & viewProjection)
+{
+	Reserve(count);
+	this->count = count;
+
+	const float * vp = &viewProjection[0][0];
+	const __m128 vp0 = _mm_loadu_ps(vp), vp1 = _mm_loadu_ps(vp + 4), vp2 = _mm_loadu_ps(vp + 8), vp3 = _mm_loadu_ps(vp + 12);
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for (int first = 0; first < count; first += 4)
+	{
+		int n = std::min(4, count - first);
+
+		// four quaternions as structure of arrays, the missing ones padded with the identity
+		__m128 x, y, z, w;
+		{
+			__m128 q[4];
+			for (int k = 0; k < 4; k++)
+				q[k] = k < n ? _mm_loadu_ps(&poses[first + k].qx) : _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+			_MM_TRANSPOSE4_PS(q[0], q[1], q[2], q[3]);
+			x = q[0]; y = q[1]; z = q[2]; w = q[3];
+		}
+
+		// rotation matrices of all four
+		__m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+		__m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+		__m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+		__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+		__m128 c0[4] = { _mm_sub_ps(one, _mm_add_ps(yy, zz)), _mm_add_ps(xy, wz), _mm_sub_ps(xz, wy), _mm_setzero_ps() };
+		__m128 c1[4] = { _mm_sub_ps(xy, wz), _mm_sub_ps(one, _mm_add_ps(xx, zz)), _mm_add_ps(yz, wx), _mm_setzero_ps() };
+		__m128 c2[4] = { _mm_add_ps(xz, wy), _mm_sub_ps(yz, wx), _mm_sub_ps(one, _mm_add_ps(xx, yy)), _mm_setzero_ps() };
+
+		// back to one column per register for each pose
+		_MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+		_MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+		_MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+
+		for (int k = 0; k < n; k++)
+		{
+			const RigidPose & pose = poses[first + k];
+			__m128 c3 = _mm_set_ps(1.0f, pose.pz, pose.py, pose.px);
+			const float * local = &localTransforms[first + k][0][0];
+			float * model = models + (first + k) * 16;
+			float * mvp = mvps + (first + k) * 16;
+			for (int column = 0; column < 4; column++)
+			{
+				__m128 m = TransformColumn(c0[k], c1[k], c2[k], c3, _mm_loadu_ps(local + column * 4));
+				_mm_store_ps(model + column * 4, m);
+				_mm_store_ps(mvp + column * 4, TransformColumn(vp0, vp1, vp2, vp3, m));
+			}
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "glm.hpp"
+
+namespace Core
+{
+	// Rigid body pose: rotation quaternion (x, y, z, w) followed by the position,
+	// the same order of fields as in PxTransform.
+	struct RigidPose
+	{
+		float qx, qy, qz, qw;
+		float px, py, pz;
+	};
+
+	// Batched transform stage: turns poses straight into model and model-view-projection matrices
+	// for a whole array of objects with SSE, four poses at a time. The results are kept in a
+	// 16-byte aligned buffer (models and MVPs back to back), ready to be uploaded in one go.
+	class TransformBatch
+	{
+	public:
+		TransformBatch();
+		~TransformBatch();
+
+		// model[i] = pose[i] * localTransforms[i], mvp[i] = viewProjection * model[i]
+		void Compose(int count, const RigidPose * poses, const glm::mat4 * localTransforms, const glm::mat4 & viewProjection);
+
+		int Size() const { return count; }
+		const glm::mat4 * GetModelMatrices() const { return (const glm::mat4 *)models; }
+		const glm::mat4 * GetMvpMatrices() const { return (const glm::mat4 *)mvps; }
+
+	private:
+		TransformBatch(const TransformBatch &);
+		TransformBatch & operator=(const TransformBatch &);
+
+		void Reserve(int count);
+
+		int count, capacity;
+		float * buffer;
+		float * models;
+		float * mvps;
+	};
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+
+namespace Core
+{
+	// Lock-free triple buffer for handing whole states from one writer thread to one reader thread.
+	// The writer fills the back slot and publishes it, the reader always gets the newest published
+	// state, and neither side ever waits for the other or sees a half-written state.
+	template <typename T>
+	class TripleBuffer
+	{
+	public:
+		TripleBuffer() : middle(1), backIndex(2), frontIndex(0) {}
+
+		// Writer side: the slot to fill for the next Publish().
+		T & Back() { return slots[backIndex]; }
+
+		void Publish()
+		{
+			int previous = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel);
+			backIndex = previous & indexMask;
+		}
+
+		// Reader side: the newest published state (the same one again if nothing new was published).
+		const T & Read()
+		{
+			if (middle.load(std::memory_order_relaxed) & freshBit)
+			{
+				int previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+				frontIndex = previous & indexMask;
+			}
+			return slots[frontIndex];
+		}
+
+	private:
+		static const int indexMask = 3;
+		static const int freshBit = 4;
+
+		T slots[3];
+		alignas(64) std::atomic<int> middle;
+		alignas(64) int backIndex;
+		alignas(64) int frontIndex;
+	};
+}
@@ -5,46 +5,61 @@
 #include <iostream>
 #include <cmath>
 #include <vector>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <sstream>
+#include <string>
+#include <ctime>
 
 #include "Shader_Loader.h"
 #include "Render_Utils.h"
 #include "Camera.h"
 #include "Texture.h"
 #include "Physics.h"
+#include "Physics_Snapshot.h"
+#include "Logger.h"
+#include "Hud.h"
+#include "Frame_Capture.h"
+#include "Ring_Buffer.h"
+#include "Triple_Buffer.h"
+#include "Scene_Store.h"
+#include "Transform_Batch.h"
+#include "Culling.h"
+#include "Mesh_Lod.h"
+#include "Mesh_Cache.h"
+#include "Lane_Config.h"
+#include "Bowling_Session.h"
+#include "Throw_Replay.h"
 
 using namespace std;
 
-// scene properties
-namespace Objects {
-    struct Properties {
-        glm::vec3 size, pos;
-    };
-
-    const int numPins = 10;
-    const float offset = 21;
-    Properties  ball{ { 0.7, 0.7, 0.7 },{ -30, 0.25, 0 } },
-        ground{ { 6, 6, 6 },{ 10, 0.25, 0 } },
-        pins[numPins] = {
-                { { 0.3, 0.3, 0.3 },{  3 + offset, 0.25, 0 } },
-                { { 0.3, 0.3, 0.3 },{  3.5 + offset, 0.25, -0.25 } },
-                { { 0.3, 0.3, 0.3 },{  3.5 + offset, 0.25, 0.25 } },
-                { { 0.3, 0.3, 0.3 },{  4.0 + offset, 0.25, 0 } },
-                { { 0.3, 0.3, 0.3 },{  4.0 + offset, 0.25, -0.5 } },
-                { { 0.3, 0.3, 0.3 },{  4.0 + offset, 0.25, 0.5 } },
-                { { 0.3, 0.3, 0.3 },{  4.5 + offset, 0.25, -0.25 } },
-                { { 0.3, 0.3, 0.3 },{  4.5 + offset, 0.25, -0.75 } },
-                { { 0.3, 0.3, 0.3 },{  4.5 + offset, 0.25, 0.25 } },
-                { { 0.3, 0.3, 0.3 },{  4.5 + offset, 0.25, 0.75 } }
-    };
-}
+// lane, rack and material parameters (config/lane.cfg or --lane-config <file>)
+const int numPins = Core::LaneConfig::numPins;
+Core::LaneConfig lane = Core::GetDefaultLaneConfig();
 
 Core::Shader_Loader shaderLoader;
 GLuint programColor;
 GLuint programTexture;
 
-obj::Model planeModel, sphereModel, pinModel;
-PxVec3 vertexes[1647];
-GLuint objectTexture, groundTexture, pinTexture;
+// meshes drawn by the scene entities (with their levels of detail), the lane is split into chunks
+// after the fixed ones so that only the visible part of it gets drawn
+enum ModelId { sphereModelId, pinModelId, firstLaneChunkId };
+vector<Core::LodMesh> meshes;
+Core::LodMesh laneMesh;
+const int meshLevels = 4;
+const int laneChunksPerAxis = 4;
+// points of the pin hull, from the pin mesh scaled like the rendered pins
+vector<PxVec3> pinHullPoints;
+// all materials live in layers of one array texture, so the whole scene uses a single texture binding
+enum TextureLayer { groundLayer, ballLayer, pinLayer, numTextureLayers };
+const char* textureFiles[numTextureLayers] = { "textures/bowling_lane.bmp", "textures/red.jpg", "textures/pinTexture.jpg" };
+const char* packedTexturesFile = "textures/scene_array.dds";
+const int textureLayerSize = 1024;
+GLuint sceneTextures;
+GLint uniformLightDir, uniformTextureSampler, uniformTextureLayer, uniformModelViewProjection, uniformModelMatrix;
+Core::PackedModelUniforms uniformsPackedModel;
 PxVec3 firstPinPos;
 glm::vec3 cameraPos = glm::vec3(-40, 2.5, 0);
 glm::vec3 cameraDir;
@@ -59,13 +74,18 @@ glm::mat4 cameraMatrix, perspectiveMatrix;
 
 glm::vec3 lightDir = glm::normalize(glm::vec3(0.5, -1, -0.5));
 
-int score = 0;
+// offscreen batch rendering (--capture), driven by a fixed frame clock instead of wall time
+Core::FrameCapture frameCapture;
+bool capturing = false;
+int captureWidth = 1000, captureHeight = 1000;
+int captureFrames = 600;
+double captureFps = 60.0;
+int capturedFrames = 0;
 // Initalization of physical scene (PhysX)
 Physics pxScene(9.8 /* gravity (m/s^2) */);
 
-// fixed timestep for stable and deterministic simulation
-const double physicsStepTime = 1.f / 60.f;
-double physicsTimeToProcess = 0;
+// fixed timestep for stable and deterministic simulation (--sim-rate 60/120/240)
+double physicsStepTime = 1.f / 60.f;
 glm::mat4 view;
 vector<double> startingPositions;
 // physical objects
@@ -74,61 +94,126 @@ PxMaterial* ballMaterial = nullptr;
 PxRigidStatic* bodyGround = nullptr;
 PxRigidDynamic* bodyHandle = nullptr,
 * pinHandle = nullptr,
-* bodyPins[Objects::numPins] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+* bodyPins[numPins] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+// renderable objects, the physics actors keep their handles in userData
+Core::SceneStore sceneStore;
+Core::SceneHandle ballEntity, pinEntities[numPins];
+vector<Core::SceneHandle> laneChunks;
+Core::RigidPose groundPose;
+// model and MVP matrices of all entities, composed in one batch per frame
+Core::TransformBatch sceneTransforms;
 
-// renderable objects (description of a single renderable instance)
-struct Renderable {
-    obj::Model* model;
-    glm::mat4 localTransform, physicsTransform;
-    GLuint textureId;
+void* toUserData(Core::SceneHandle handle)
+{
+    return (void*)(uintptr_t)handle;
+}
+
+Core::SceneHandle fromUserData(void* userData)
+{
+    return (Core::SceneHandle)(uintptr_t)userData;
+}
+
+Core::RigidPose toRigidPose(const PxTransform& transform)
+{
+    return { transform.q.x, transform.q.y, transform.q.z, transform.q.w, transform.p.x, transform.p.y, transform.p.z };
+}
+
+// Physics, pin checks and scoring run on the simulation thread at a fixed rate.
+// After every step it publishes an immutable snapshot of the actor poses, which the render
+// thread picks up without locking; input goes the other way through a command queue.
+// Each snapshot carries the poses from before and after the last step, so the renderer can
+// blend between them at any display rate.
+struct SceneSnapshot {
+    struct Object {
+        Core::SceneHandle entity;
+        PxTransform previousPose, pose;
+    };
+    static const int maxObjects = 16;
+    Object objects[maxObjects];
+    int numObjects = 0;
+    double time = 0;
+    double droppedTime = 0;
+    int rackId = 0;
 };
-Renderable rendGround, rendHandle, rendPin, rendPins[10];
-vector<Renderable*> renderables;
-vector<int> pinsDownIndexes;
+Core::TripleBuffer<SceneSnapshot> snapshots;
+
+enum class SimCommandType { Throw, Reset };
+struct SimCommand {
+    SimCommandType type;
+    float aim, power;
+};
+Core::RingBuffer<SimCommand, 64> simCommands;
+
+typedef chrono::steady_clock Clock;
+Clock::time_point simulationStart;
+thread simulationThread;
+atomic<bool> simulationRunning(false);
+double simulationTime = 0;
+int rackId = 0;
+
+// poses of the actors right before the latest step (simulation thread only)
+struct PreviousPose {
+    PxRigidActor* actor;
+    PxTransform pose;
+};
+vector<PreviousPose> previousPoses;
+
+void loadModels()
+{
+    // parsed and simplified once, later runs read the processed meshes from mesh_cache/
+    meshes.resize(firstLaneChunkId);
+    Core::LoadLodMesh(laneMesh, "models/wenju.obj", 1);
+    Core::LoadLodMesh(meshes[sphereModelId], "models/sphere.obj", meshLevels);
+    Core::LoadLodMesh(meshes[pinModelId], "models/bowlingPin.obj", meshLevels);
+    obj::Model pinModel = Core::UnpackModel(meshes[pinModelId].levels[0]);
+    pinHullPoints.clear();
+    for (size_t i = 0; i + 2 < pinModel.vertex.size(); i += 3) {
+        pinHullPoints.push_back(PxVec3(pinModel.vertex[i] * lane.pinSize.x, pinModel.vertex[i + 1] * lane.pinSize.y, pinModel.vertex[i + 2] * lane.pinSize.z));
+    }
+}
 
 void initRenderables()
 {
     //get starting pin positions x'es
     for (int i = 0; i < 10; i++) {
-        startingPositions.push_back(Objects::pins[i].pos.x);
+        startingPositions.push_back(lane.pinPositions[i].x);
     }
     // load models
-    planeModel = obj::loadModelFromFile("models/wenju.obj");
-    sphereModel = obj::loadModelFromFile("models/sphere.obj");
-    pinModel = obj::loadModelFromFile("models/bowlingPin.obj");
-    int j = 0;
-    for (int i = 0; i < pinModel.vertex.size(); i += 3) {
-        vertexes[j] = PxVec3(pinModel.vertex[i] * 0.3, pinModel.vertex[i + 1] * 0.3, pinModel.vertex[i + 2] * 0.3);
-        j++;
-    }
-    // load textures
-    groundTexture = Core::LoadTexture("textures/bowling_lane.bmp");
-    objectTexture = Core::LoadTexture("textures/red.jpg");
-    pinTexture = Core::LoadTexture("textures/pinTexture.jpg");
-
-    // This time we organize all the renderables in a list
+    loadModels();
+    // load textures (decoded in the background, a placeholder is bound until they arrive)
+    sceneTextures = Core::LoadTextureArrayAsync(textureFiles, numTextureLayers, textureLayerSize, packedTexturesFile);
+
+    // This time we organize all the renderables in a store
     // of basic properties (model, transform, texture),
     // to unify their rendering and simplify their managament
     // in connection to the physics simulation
 
-    // create ground
-    rendGround.model = &planeModel;
-    rendGround.textureId = groundTexture;
-    rendGround.localTransform = glm::rotate(29.845f, glm::vec3(0.f, 0.f, 1.f)) * glm::rotate(29.843f, glm::vec3(0.f, 1.f, 0.f)) * glm::scale(Objects::ground.size * 0.4f);
-    renderables.emplace_back(&rendGround);
+    Core::ReportLodMesh(meshes[sphereModelId], "ball", 1000);
+    Core::ReportLodMesh(meshes[pinModelId], "pin", 1000);
+    Core::ReportLodMesh(laneMesh, "lane", 1000);
+
+    vector<obj::Model> laneModels = Core::SplitModel(Core::UnpackModel(laneMesh.levels[0]), laneChunksPerAxis);
+    meshes.resize(firstLaneChunkId + laneModels.size());
+
+    // create ground (the lane is flat and close, so its chunks keep the full detail)
+    glm::mat4 groundTransform = glm::rotate(29.845f, glm::vec3(0.f, 0.f, 1.f)) * glm::rotate(29.843f, glm::vec3(0.f, 1.f, 0.f)) * glm::scale(lane.groundSize * 0.4f);
+    for (size_t i = 0; i < laneModels.size(); i++) {
+        Core::BuildLodMesh(meshes[firstLaneChunkId + i], laneModels[i], 1);
+        laneChunks.push_back(sceneStore.Create(firstLaneChunkId + (int)i, groundLayer, groundTransform));
+    }
 
     // create handle
-    rendHandle.model = &sphereModel;
-    rendHandle.textureId = objectTexture;
-    rendHandle.localTransform = glm::scale(Objects::ball.size * 0.5f);
-    renderables.emplace_back(&rendHandle);
+    ballEntity = sceneStore.Create(sphereModelId, ballLayer, glm::scale(lane.ballSize * 0.5f));
 
     //create Pin
-    for (int i = 0; i < Objects::numPins; i++) {
-        rendPins[i].model = &pinModel;
-        rendPins[i].textureId = pinTexture;
-        rendPins[i].localTransform = glm::scale(Objects::pins[i].size);
-        renderables.emplace_back(&rendPins[i]);
+    for (int i = 0; i < numPins; i++) {
+        pinEntities[i] = sceneStore.Create(pinModelId, pinLayer, glm::scale(lane.pinSize));
+    }
+
+    // vertex and index buffers of every level on the GPU
+    for (Core::LodMesh& mesh : meshes) {
+        Core::UploadLodMesh(mesh);
     }
 
 }
@@ -140,74 +225,224 @@ PxBoxGeometry sizeToPxBoxGeometry(glm::vec3 const& size) {
 }
 
 vector<PxRigidDynamic*> pinsBody;
-void createDynamicPin(PxRigidDynamic*& body, Renderable* rend, glm::vec3 const& pos, glm::vec3 const& size)
+// The lane (materials, the cooked pin hull and the ground) and a full rack (ball and pins) are
+// built once and serialized. From then on they are created from these snapshots: the lane at
+// startup and the rack on every reset, in place in the rack arena with no cooking.
+const PxSerialObjectId pinMaterialObjectId = 1, ballMaterialObjectId = 2, pinMeshObjectId = 3, groundObjectId = 4,
+    ballObjectId = 5, firstPinObjectId = 6;
+PhysicsSnapshot laneSnapshot, rackSnapshot;
+PxConvexMesh* pinConvexMesh = nullptr;
+
+PxConvexMesh* cookPinMesh()
 {
     PxConvexMeshDesc convexDesc;
-    convexDesc.points.count = 1647;
+    convexDesc.points.count = (PxU32)pinHullPoints.size();
     convexDesc.points.stride = sizeof(PxVec3);
-    convexDesc.points.data = vertexes;
+    convexDesc.points.data = pinHullPoints.data();
     convexDesc.flags = PxConvexFlag::eCOMPUTE_CONVEX;
 
-    PxDefaultMemoryOutputStream buf;
+    // the cooked data is only needed until the mesh is created, so it lives in the rack arena
+    PxDefaultMemoryOutputStream buf(pxScene.rackArena);
     PxConvexMeshCookingResult::Enum result;
     if (!pxScene.cooking->cookConvexMesh(convexDesc, buf, &result))
-        cout << "can't initialize mesh";
+        Core::Log(Core::LogLevel::Error, "can't initialize mesh");
 
     PxDefaultMemoryInputData input(buf.getData(), buf.getSize());
-    PxConvexMesh* convexMesh = pxScene.physics->createConvexMesh(input);
+    return pxScene.physics->createConvexMesh(input);
+}
 
-    body = pxScene.physics->createRigidDynamic(PxTransform(pos.x, pos.y, pos.z));
+PxRigidDynamic* createDynamicPin(glm::vec3 const& pos, glm::vec3 const& size, PxConvexMesh* convexMesh, PxMaterial* pinMaterial)
+{
+    PxRigidDynamic* body = pxScene.physics->createRigidDynamic(PxTransform(pos.x, pos.y, pos.z));
     //PxShape* aConvexShape = PxRigidActorExt::createExclusiveShape(*body, PxConvexMeshGeometry(convexMesh), *material);
-    PxShape* aConvexShape = pxScene.physics->createShape(PxConvexMeshGeometry(convexMesh), *material);
+    PxShape* aConvexShape = pxScene.physics->createShape(PxConvexMeshGeometry(convexMesh), *pinMaterial);
     body->setMass(10.f);
     body->attachShape(*aConvexShape);
-    body->userData = rend;
-    pinsBody.push_back(body);
-    pxScene.scene->addActor(*body);
     aConvexShape->release();
+    return body;
 }
 
-void createDynamicSphere(PxRigidDynamic*& body, Renderable* rend, glm::vec3 const& pos, float radius)
+PxRigidDynamic* createDynamicSphere(glm::vec3 const& pos, float radius, PxMaterial* sphereMaterial)
 {
-    body = pxScene.physics->createRigidDynamic(PxTransform(pos.x, pos.y, pos.z));
-    PxShape* sphereShape = pxScene.physics->createShape(PxSphereGeometry(radius), *ballMaterial);
+    PxRigidDynamic* body = pxScene.physics->createRigidDynamic(PxTransform(pos.x, pos.y, pos.z));
+    PxShape* sphereShape = pxScene.physics->createShape(PxSphereGeometry(radius), *sphereMaterial);
     body->attachShape(*sphereShape);
     sphereShape->release();
-    body->userData = rend;
-    pxScene.scene->addActor(*body);
+    return body;
 }
 
-void initPhysicsScene()
+void trackObjects(const PxCollection& collection)
+{
+    for (PxU32 i = 0; i < collection.getNbObjects(); i++) {
+        pxScene.auditor.track(collection.getObject(i));
+    }
+}
+
+// builds the lane and a full rack once the imperative way, keeps them as snapshots and releases them
+void buildPhysicsSnapshots()
 {
     // material for ball and pins
-    material = pxScene.physics->createMaterial(5.f, 5.f, 0.2f);
-    ballMaterial = pxScene.physics->createMaterial(3.f, 10.f, 0.01f);
+    PxMaterial* pinMaterial = pxScene.physics->createMaterial(lane.pinMaterial.staticFriction, lane.pinMaterial.dynamicFriction, lane.pinMaterial.restitution);
+    PxMaterial* sphereMaterial = pxScene.physics->createMaterial(lane.ballMaterial.staticFriction, lane.ballMaterial.dynamicFriction, lane.ballMaterial.restitution);
+    PxConvexMesh* convexMesh = cookPinMesh();
     // create ground
-    bodyGround = pxScene.physics->createRigidStatic(PxTransformFromPlaneEquation(PxPlane(0, 1, 0, 0)));
-    PxShape* planeShape = pxScene.physics->createShape(PxPlaneGeometry(), *material);
-    bodyGround->attachShape(*planeShape);
+    PxRigidStatic* ground = pxScene.physics->createRigidStatic(PxTransformFromPlaneEquation(PxPlane(0, 1, 0, 0)));
+    PxShape* planeShape = pxScene.physics->createShape(PxPlaneGeometry(), *pinMaterial);
+    ground->attachShape(*planeShape);
     planeShape->release();
-    bodyGround->userData = &rendGround;
-    pxScene.scene->addActor(*bodyGround);
 
     // create ball
-    createDynamicSphere(bodyHandle, &rendHandle, Objects::ball.pos, Objects::ball.size.x * 0.5f);
-    bodyHandle->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, false);
-    PxRigidBodyExt::setMassAndUpdateInertia(*bodyHandle, 8.f);
+    PxRigidDynamic* ball = createDynamicSphere(lane.ballPosition, lane.ballSize.x * 0.5f, sphereMaterial);
+    ball->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, false);
+    PxRigidBodyExt::setMassAndUpdateInertia(*ball, lane.ballMass);
 
     // create pins
-    for (int i = 0; i < Objects::numPins; i++) {
-        createDynamicPin(bodyPins[i], &rendPins[i], Objects::pins[i].pos, Objects::pins[i].size);
-        PxRigidBodyExt::setMassAndUpdateInertia(*bodyPins[i], 0.2f);
+    PxRigidDynamic* pins[numPins];
+    for (int i = 0; i < numPins; i++) {
+        pins[i] = createDynamicPin(lane.pinPositions[i], lane.pinSize, convexMesh, pinMaterial);
+        PxRigidBodyExt::setMassAndUpdateInertia(*pins[i], lane.pinMass);
     }
 
+    PxCollection* laneObjects = PxCreateCollection();
+    laneObjects->add(*pinMaterial, pinMaterialObjectId);
+    laneObjects->add(*sphereMaterial, ballMaterialObjectId);
+    laneObjects->add(*convexMesh, pinMeshObjectId);
+    laneObjects->add(*ground, groundObjectId);
+    PxCollection* rackObjects = PxCreateCollection();
+    rackObjects->add(*ball, ballObjectId);
+    for (int i = 0; i < numPins; i++) {
+        rackObjects->add(*pins[i], firstPinObjectId + i);
+    }
+    laneSnapshot.serialize(*laneObjects, *pxScene.serializationRegistry);
+    rackSnapshot.serialize(*rackObjects, *pxScene.serializationRegistry, laneObjects);
+    Core::Log(Core::LogLevel::Info, "physics snapshots: lane %zu bytes, rack %zu bytes", laneSnapshot.getSize(), rackSnapshot.getSize());
+
+    // serialize() completed the collections with the shapes
+    trackObjects(*laneObjects);
+    trackObjects(*rackObjects);
+    laneObjects->release();
+    rackObjects->release();
+    ball->release();
+    for (int i = 0; i < numPins; i++) {
+        pins[i]->release();
+    }
+    ground->release();
+    convexMesh->release();
+    pinMaterial->release();
+    sphereMaterial->release();
+}
 
+// creates the ball and the pins that are not in downIndexes (sorted) from the rack snapshot
+void instantiateRack(vector<int> const& downIndexes)
+{
+    // the objects of the lane the rack refers to, under the ids they were serialized with
+    PxCollection* laneObjects = PxCreateCollection();
+    laneObjects->add(*material, pinMaterialObjectId);
+    laneObjects->add(*ballMaterial, ballMaterialObjectId);
+    laneObjects->add(*pinConvexMesh, pinMeshObjectId);
+    PxCollection* rackObjects = rackSnapshot.instantiate(pxScene.rackArena, *pxScene.serializationRegistry, laneObjects);
+    laneObjects->release();
+    if (!rackObjects) return;
+    trackObjects(*rackObjects);
+
+    bodyHandle = rackObjects->find(ballObjectId)->is<PxRigidDynamic>();
+    bodyHandle->userData = toUserData(ballEntity);
+    pxScene.scene->addActor(*bodyHandle);
+    for (int i = 0; i < numPins; i++) {
+        PxRigidDynamic* pin = rackObjects->find(firstPinObjectId + i)->is<PxRigidDynamic>();
+        if (binary_search(downIndexes.begin(), downIndexes.end(), i)) {
+            pin->release();
+            continue;
+        }
+        pin->userData = toUserData(pinEntities[i]);
+        bodyPins[i] = pin;
+        pinsBody.push_back(pin);
+        pxScene.scene->addActor(*pin);
+    }
+    rackObjects->release();
 }
 
-void updateTransforms()
+void initPhysicsScene()
 {
-    // Here we retrieve the current transforms of the objects from the physical simulation.
-    auto actorFlags = PxActorTypeFlag::eRIGID_DYNAMIC | PxActorTypeFlag::eRIGID_STATIC;
+    buildPhysicsSnapshots();
+
+    // the lane lives as long as the scene
+    PxCollection* laneObjects = laneSnapshot.instantiate(pxScene.sceneArena, *pxScene.serializationRegistry);
+    trackObjects(*laneObjects);
+    material = laneObjects->find(pinMaterialObjectId)->is<PxMaterial>();
+    ballMaterial = laneObjects->find(ballMaterialObjectId)->is<PxMaterial>();
+    pinConvexMesh = laneObjects->find(pinMeshObjectId)->is<PxConvexMesh>();
+    bodyGround = laneObjects->find(groundObjectId)->is<PxRigidStatic>();
+    laneObjects->release();
+    // the ground never moves, so its chunks are placed once instead of going through the snapshots
+    PxTransform groundTransform = bodyGround->getGlobalPose();
+    groundPose = toRigidPose(groundTransform);
+    pxScene.scene->addActor(*bodyGround);
+
+    instantiateRack({});
+}
+
+// Frame budget governor: the simulation runs at most maxCatchUpSteps per update and gives up
+// the rest of the backlog, and when stepping takes too much of the real time it degrades in
+// levels (1 - fewer solver iterations and substeps, 2 - also slow motion) instead of freezing.
+const int maxCatchUpSteps = 4;
+const double overloadedLoad = 0.8, relaxedLoad = 0.4;
+const int governorHoldSteps = 60;
+bool governorEnabled = true;
+struct PhysicsCounters {
+    long long steps = 0;
+    long long cappedUpdates = 0;
+    double droppedTime = 0;
+    double stepCostEma = 0;
+    double load = 0;
+    int degradeLevel = 0;
+    int peakDegradeLevel = 0;
+    int levelChanges = 0;
+};
+PhysicsCounters physicsCounters;
+const char* degradeLevelNames[] = { "normal", "reduced solver iterations", "slow motion" };
+
+double simulationTimeScale()
+{
+    return physicsCounters.degradeLevel >= 2 ? 0.5 : 1.0;
+}
+
+void applySolverIterations()
+{
+    PxU32 positionIterations = physicsCounters.degradeLevel >= 1 ? 2 : 4;
+    if (bodyHandle) bodyHandle->setSolverIterationCounts(positionIterations, 1);
+    for (auto pin : pinsBody) {
+        pin->setSolverIterationCounts(positionIterations, 1);
+    }
+}
+
+void updateGovernor(double stepCost)
+{
+    static int stepsSinceChange = 0;
+    PhysicsCounters& c = physicsCounters;
+    c.stepCostEma = c.stepCostEma == 0 ? stepCost : c.stepCostEma * 0.95 + stepCost * 0.05;
+    // share of the real time spent stepping at the current rate
+    c.load = c.stepCostEma / physicsStepTime * simulationTimeScale();
+    if (!governorEnabled || ++stepsSinceChange < governorHoldSteps) return;
+
+    int level = c.degradeLevel;
+    if (c.load > overloadedLoad && level < 2) level++;
+    else if (c.load < relaxedLoad && level > 0) level--;
+    if (level == c.degradeLevel) return;
+
+    Core::Log(level > c.degradeLevel ? Core::LogLevel::Warning : Core::LogLevel::Info,
+        "physics step %.2f ms, load %.0f%%: switching to %s", c.stepCostEma * 1000.0, c.load * 100.0, degradeLevelNames[level]);
+    c.degradeLevel = level;
+    c.peakDegradeLevel = max(c.peakDegradeLevel, level);
+    c.levelChanges++;
+    stepsSinceChange = 0;
+    applySolverIterations();
+}
+
+void storePreviousPoses()
+{
+    previousPoses.clear();
+    auto actorFlags = PxActorTypeFlag::eRIGID_DYNAMIC;
     PxU32 nbActors = pxScene.scene->getNbActors(actorFlags);
     if (nbActors)
     {
@@ -215,76 +450,93 @@ void updateTransforms()
         pxScene.scene->getActors(actorFlags, (PxActor**)&actors[0], nbActors);
         for (auto actor : actors)
         {
-            // We use the userData of the objects to set up the model matrices
-            // of proper renderables.
-            if (!actor->userData) continue;
-            Renderable* renderable = (Renderable*)actor->userData;
+            previousPoses.push_back({ actor, actor->getGlobalPose() });
+        }
+    }
+}
 
-            // get world matrix of the object (actor)
-            PxMat44 transform = actor->getGlobalPose();
-            auto& c0 = transform.column0;
-            auto& c1 = transform.column1;
-            auto& c2 = transform.column2;
-            auto& c3 = transform.column3;
+void publishSnapshot()
+{
+    // Here we retrieve the current transforms of the objects from the physical simulation.
+    SceneSnapshot& snapshot = snapshots.Back();
+    snapshot.numObjects = 0;
+    snapshot.time = simulationTime;
+    snapshot.droppedTime = physicsCounters.droppedTime;
+    snapshot.rackId = rackId;
 
-            // set up the model matrix used for the rendering
-            renderable->physicsTransform = glm::mat4(
-                c0.x, c0.y, c0.z, c0.w,
-                c1.x, c1.y, c1.z, c1.w,
-                c2.x, c2.y, c2.z, c2.w,
-                c3.x, c3.y, c3.z, c3.w);
+    auto actorFlags = PxActorTypeFlag::eRIGID_DYNAMIC | PxActorTypeFlag::eRIGID_STATIC;
+    PxU32 nbActors = pxScene.scene->getNbActors(actorFlags);
+    if (nbActors)
+    {
+        vector<PxRigidActor*> actors(nbActors);
+        pxScene.scene->getActors(actorFlags, (PxActor**)&actors[0], nbActors);
+        for (auto actor : actors)
+        {
+            // We use the userData of the objects to find the proper renderables.
+            if (!actor->userData || snapshot.numObjects == SceneSnapshot::maxObjects) continue;
+            SceneSnapshot::Object& object = snapshot.objects[snapshot.numObjects++];
+            object.entity = fromUserData(actor->userData);
+            object.pose = actor->getGlobalPose();
+            // actors added since the last step (or static ones) have nothing to blend from
+            object.previousPose = object.pose;
+            for (auto& previous : previousPoses)
+            {
+                if (previous.actor == actor) {
+                    object.previousPose = previous.pose;
+                    break;
+                }
+            }
         }
     }
+    snapshots.Publish();
 }
 
-void moveHandle(float offset) {
+// pose of the object (actor) between two poses, alpha 0 gives the first one
+Core::RigidPose interpolatePose(PxTransform const& from, PxTransform const& to, float alpha)
+{
+    glm::vec3 position = glm::mix(glm::vec3(from.p.x, from.p.y, from.p.z), glm::vec3(to.p.x, to.p.y, to.p.z), alpha);
+    glm::quat rotation = glm::slerp(glm::quat(from.q.w, from.q.x, from.q.y, from.q.z), glm::quat(to.q.w, to.q.x, to.q.y, to.q.z), alpha);
+    return { rotation.x, rotation.y, rotation.z, rotation.w, position.x, position.y, position.z };
+}
+
+void moveHandle(float aim, float offset) {
     if (!bodyHandle) return;
-    bodyHandle->setAngularVelocity(PxVec3(-camZ * 35.f, 0.f, offset));
+    bodyHandle->setAngularVelocity(PxVec3(-aim * 35.f, 0.f, offset));
 }
 bool blocked = false;
 //maybe pass array of fallen pins and reset without them if provided.
 void resetPinsAndBall(vector<int>downIndexes) {
     pinsBody.clear();
     startingPositions.clear();
-    blocked = false;
+    previousPoses.clear();
+    rackId++;
     sort(downIndexes.begin(), downIndexes.end());
-    renderables.clear();
-    for (int i = 0; i < Objects::numPins; i++) {
-        renderables.emplace_back(&rendGround);
-        renderables.emplace_back(&rendHandle);
+    for (int i = 0; i < numPins; i++) {
         if (!binary_search(downIndexes.begin(), downIndexes.end(), i)) {
-            rendPins[i].model = &pinModel;
-            rendPins[i].textureId = pinTexture;
-            rendPins[i].localTransform = glm::scale(Objects::pins[i].size);
-            renderables.emplace_back(&rendPins[i]);
-            startingPositions.push_back(Objects::pins[i].pos.x);
+            startingPositions.push_back(lane.pinPositions[i].x);
         }
     }
-    for (int i = 0; i < Objects::numPins; i++) {
-        pxScene.scene->removeActor(*bodyPins[i]);
-    }
-    pxScene.scene->removeActor(*bodyHandle);
-
-    // create ground
-    bodyGround = pxScene.physics->createRigidStatic(PxTransformFromPlaneEquation(PxPlane(0, 1, 0, 0)));
-    PxShape* planeShape = pxScene.physics->createShape(PxPlaneGeometry(), *material);
-    bodyGround->attachShape(*planeShape);
-    planeShape->release();
-    bodyGround->userData = &rendGround;
-    pxScene.scene->addActor(*bodyGround);
-
-    // create ball
-    createDynamicSphere(bodyHandle, &rendHandle, Objects::ball.pos, Objects::ball.size.x * 0.5f);
-    bodyHandle->setRigidBodyFlag(PxRigidBodyFlag::eKINEMATIC, false);
-    PxRigidBodyExt::setMassAndUpdateInertia(*bodyHandle, 8.f);
-
-    // create pins
-    for (int i = 0; i < Objects::numPins; i++) {
-        if (!binary_search(downIndexes.begin(), downIndexes.end(), i)) {
-            createDynamicPin(bodyPins[i], &rendPins[i], Objects::pins[i].pos, Objects::pins[i].size);
-            PxRigidBodyExt::setMassAndUpdateInertia(*bodyPins[i], 0.2f);
+    // release() also removes the actors from the scene, the pins knocked down
+    // in the previous rack were not created again and are already gone
+    for (int i = 0; i < numPins; i++) {
+        if (bodyPins[i]) {
+            bodyPins[i]->release();
+            bodyPins[i] = nullptr;
         }
     }
+    if (bodyHandle) {
+        bodyHandle->release();
+        bodyHandle = nullptr;
+    }
+
+    // nothing of the previous rack lives in the arena any more
+    Core::Log(Core::LogLevel::Debug, "rack %d: physics memory %.1f KB live in %zu blocks, %.1f KB peak, %.1f KB pooled, arena %.1f KB of %.1f KB",
+        rackId, pxScene.allocator.getLiveBytes() / 1024.0, pxScene.allocator.getLiveCount(), pxScene.allocator.getPeakBytes() / 1024.0,
+        pxScene.allocator.getPooledBytes() / 1024.0, pxScene.rackArena.getPeakBytes() / 1024.0, pxScene.rackArena.getReservedBytes() / 1024.0);
+    pxScene.rackArena.reset();
+    instantiateRack(downIndexes);
+    applySolverIterations();
+    pxScene.auditor.checkRack(rackId, pxScene.allocator.getLiveBytes());
 }
 glm::mat4 createCameraMatrix()
 {
@@ -294,6 +546,77 @@ glm::mat4 createCameraMatrix()
     return Core::createViewMatrix(cameraPos, cameraDir, up);
 }
 int vpress = 0;
+
+// --replay <file>: shows a recorded throw instead of running the game, the physics is never
+// stepped; ',' and '.' seek by a second, space pauses, '-' and '+' change the speed
+Core::ThrowReplay playbackReplay;
+Core::ReplayPlayer replayPlayer;
+bool replaying = false;
+bool replayPaused = false;
+double replayPosition = 0;
+// time of the last replay frame, -1 before the first one
+double replayFrameTime = -1;
+const float replaySpeeds[] = { 0.1f, 0.25f, 0.5f, 1.f, 2.f, 4.f };
+const int numReplaySpeeds = sizeof(replaySpeeds) / sizeof(replaySpeeds[0]);
+int replaySpeed = 3;
+
+// Instant replay of strikes and spares: the render thread shows the recorded throw while the
+// simulation thread already sets up the next rack, the free camera orbits the pins meanwhile.
+// Enter skips it.
+bool instantReplay = false;
+const int instantReplaySpeed = 2;
+const float orbitSpeed = 0.25f;
+const float minOrbitDistance = 1.5f;
+glm::vec3 orbitCenter;
+// the camera as it was before the instant replay
+int savedVpress;
+glm::vec3 savedCameraPos;
+float savedCameraAngle;
+
+void startInstantReplay(const Core::ThrowReplay& replay)
+{
+    playbackReplay = replay;
+    if (!replayPlayer.Open(playbackReplay)) return;
+    // a replay that replaces another one keeps the camera saved by the first
+    if (!instantReplay) {
+        savedVpress = vpress;
+        savedCameraPos = cameraPos;
+        savedCameraAngle = cameraAngle;
+    }
+    instantReplay = true;
+    replayPaused = false;
+    replayPosition = 0;
+    replayFrameTime = -1;
+    replaySpeed = instantReplaySpeed;
+
+    orbitCenter = glm::vec3(0.f);
+    for (int i = 0; i < numPins; i++) {
+        orbitCenter += lane.pinPositions[i] / (float)numPins;
+    }
+    // starts from the bowler's side, a few metres in front of the rack
+    vpress = 1;
+    cameraAngle = 1.58f;
+    cameraPos = glm::vec3(orbitCenter.x - 6.f, 1.5f, orbitCenter.z);
+}
+
+void endInstantReplay()
+{
+    instantReplay = false;
+    vpress = savedVpress;
+    cameraPos = savedCameraPos;
+    cameraAngle = savedCameraAngle;
+}
+
+// keeps the free camera on a circle around the rack: the keys still move it, the distance
+// they leave is kept while the angle turns on
+void orbitCamera(float seconds)
+{
+    glm::vec2 offset(cameraPos.x - orbitCenter.x, cameraPos.z - orbitCenter.z);
+    float distance = glm::max(glm::length(offset), minOrbitDistance);
+    cameraAngle += orbitSpeed * seconds;
+    glm::vec3 direction(cosf(cameraAngle - glm::radians(90.0f)), 0, sinf(cameraAngle - glm::radians(90.0f)));
+    cameraPos = glm::vec3(orbitCenter.x, cameraPos.y, orbitCenter.z) - direction * distance;
+}
 int leftButtonState = 3;
 void keyboard(unsigned char key, int x, int y)
 {
@@ -316,9 +639,18 @@ void keyboard(unsigned char key, int x, int y)
         }
         break;
     case 'r':
-        resetPinsAndBall({});
+        simCommands.Push({ SimCommandType::Reset, 0.f, 0.f });
         leftButtonState = 3;
         break;
+    case ' ': replayPaused = !replayPaused; break;
+    case ',': replayPosition = max(0.0, replayPosition - 1.0); break;
+    case '.': replayPosition = min((double)replayPlayer.GetDuration(), replayPosition + 1.0); break;
+    case '-': replaySpeed = max(replaySpeed - 1, 0); break;
+    case '+':
+    case '=': replaySpeed = min(replaySpeed + 1, numReplaySpeeds - 1); break;
+    case '\r':
+        if (instantReplay) endInstantReplay();
+        break;
     }
 }
 float differenceZ;
@@ -336,7 +668,7 @@ void mouse(int x, int y)
         camZ = -4;
     }
     view = glm::lookAt(glm::vec3(camX, cameraPos.y, camZ),
-        Objects::ball.pos,
+        lane.ballPosition,
         glm::vec3(0.0f, 1.0f, 0.0f));
     lastPosition = x;
 }
@@ -356,7 +688,7 @@ void buttonClicks(int button, int state, int x, int y) {
             leftButtonState = GLUT_UP;
             endTime = fmod(clickTime, 600.f);
             blocked = true;
-            moveHandle(-endTime);
+            simCommands.Push({ SimCommandType::Throw, camZ, (float)-endTime });
             clickTime = 0;
         }
     }
@@ -365,7 +697,7 @@ void buttonClicks(int button, int state, int x, int y) {
 
 
 
-void drawObjectColor(obj::Model* model, glm::mat4 modelMatrix, glm::vec3 color)
+void drawObjectColor(const Core::PackedModel& model, glm::mat4 modelMatrix, glm::vec3 color)
 {
     GLuint program = programColor;
 
@@ -378,82 +710,448 @@ void drawObjectColor(obj::Model* model, glm::mat4 modelMatrix, glm::vec3 color)
     glUniformMatrix4fv(glGetUniformLocation(program, "modelViewProjectionMatrix"), 1, GL_FALSE, (float*)&transformation);
     glUniformMatrix4fv(glGetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, (float*)&modelMatrix);
 
-    Core::DrawModel(model);
+    Core::DrawPackedModel(model, Core::GetPackedModelUniforms(program));
 
     glUseProgram(0);
 }
 
-void drawObjectTexture(obj::Model* model, glm::mat4 modelMatrix, GLuint textureId)
+void findTextureUniforms()
 {
-    GLuint program = programTexture;
+    uniformLightDir = glGetUniformLocation(programTexture, "lightDir");
+    uniformTextureSampler = glGetUniformLocation(programTexture, "textureSampler");
+    uniformTextureLayer = glGetUniformLocation(programTexture, "textureLayer");
+    uniformModelViewProjection = glGetUniformLocation(programTexture, "modelViewProjectionMatrix");
+    uniformModelMatrix = glGetUniformLocation(programTexture, "modelMatrix");
+    uniformsPackedModel = Core::GetPackedModelUniforms(programTexture);
+}
 
-    glUseProgram(program);
+// binds the program and the scene texture array once for all textured draws
+void beginTexturedPass()
+{
+    glUseProgram(programTexture);
+    glUniform3f(uniformLightDir, lightDir.x, lightDir.y, lightDir.z);
+    glUniform1i(uniformTextureSampler, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, sceneTextures);
+}
 
-    glUniform3f(glGetUniformLocation(program, "lightDir"), lightDir.x, lightDir.y, lightDir.z);
-    Core::SetActiveTexture(textureId, "textureSampler", program, 0);
+void drawObjectTexture(const Core::PackedModel& model, glm::mat4 const& modelMatrix, glm::mat4 const& transformation, int textureLayer)
+{
+    glUniformMatrix4fv(uniformModelViewProjection, 1, GL_FALSE, (float*)&transformation);
+    glUniformMatrix4fv(uniformModelMatrix, 1, GL_FALSE, (float*)&modelMatrix);
+    glUniform1i(uniformTextureLayer, textureLayer);
 
-    glm::mat4 transformation = perspectiveMatrix * cameraMatrix * modelMatrix;
-    glUniformMatrix4fv(glGetUniformLocation(program, "modelViewProjectionMatrix"), 1, GL_FALSE, (float*)&transformation);
-    glUniformMatrix4fv(glGetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, (float*)&modelMatrix);
+    Core::DrawPackedModel(model, uniformsPackedModel);
+}
+// bowlers taking turns on this lane (--players, --lane), the scores go to the score log
+Core::BowlingSession session;
+int sessionLane = 0;
+const char* scoreLogFile = "scores.bin";
+// pins of the current rack seen knocked down during this ball
+bool pinFallen[numPins] = {};
+int pinsDownThisBall = 0;
+// when the ball was thrown and the first pin went down, -1 until then
+double throwTime = -1;
+double firstPinDownTime = -1;
+// the pins get this long to settle after the first one went down
+const double pinSettleTime = 2.0;
+// a ball that knocks nothing down ends after this long (gutter ball)
+const double gutterBallTime = 8.0;
+
+// every throw is recorded at about 60 Hz and saved to replays/ (--replay <file> plays one back);
+// track 0 is the ball and track 1 + i pin i
+const int numReplayTracks = 1 + numPins;
+const char* replayDirectory = "replays";
+Core::ReplayRecorder replayRecorder;
+int replaySampleSteps = 1;
+int replayStepCount = 0;
+
+void addReplaySample()
+{
+    Core::RigidPose poses[numReplayTracks] = {};
+    if (bodyHandle) poses[0] = toRigidPose(bodyHandle->getGlobalPose());
+    for (int i = 0; i < numPins; i++) {
+        if (bodyPins[i]) poses[1 + i] = toRigidPose(bodyPins[i]->getGlobalPose());
+    }
+    replayRecorder.AddSample(poses);
+}
 
-    Core::DrawModel(model);
+void beginReplay()
+{
+    unsigned trackMask = bodyHandle ? 1u : 0u;
+    for (int i = 0; i < numPins; i++) {
+        if (bodyPins[i]) trackMask |= 1u << (1 + i);
+    }
+    replaySampleSteps = max(1, (int)lround(1.0 / 60.0 / physicsStepTime));
+    replayStepCount = 0;
+    replayRecorder.Begin(numReplayTracks, trackMask, (float)(physicsStepTime * replaySampleSteps));
+    addReplaySample();
+}
 
-    glUseProgram(0);
+// after every step of the simulation, the physics is not touched while nothing is recorded
+void recordReplayStep()
+{
+    if (replayRecorder.IsRecording() && ++replayStepCount % replaySampleSteps == 0) {
+        addReplaySample();
+    }
 }
-vector <bool> checked(10, false);
-bool first = true;
-double pinDownTimer = 0;
-int throwNumber = 1;
-int finalScore = 0;
-void renderScene()
+
+// strikes and spares go to the render thread for an instant replay, a new id starts one
+struct InstantReplay {
+    int id = 0;
+    Core::ThrowReplay replay;
+};
+Core::TripleBuffer<InstantReplay> instantReplays;
+int instantReplayCount = 0;
+
+void clearBall()
 {
-    double time = glutGet(GLUT_ELAPSED_TIME) / 1000.0;
-    static double prevTime = time;
-    double dtime = time - prevTime;
-    prevTime = time;
-
-    // Update physics
-    if (dtime < 1.f) {
-        physicsTimeToProcess += dtime;
-        while (physicsTimeToProcess > 0) {
-            // here we perform the physics simulation step
-            pxScene.step(physicsStepTime);
-            physicsTimeToProcess -= physicsStepTime;
-        }
-    }
-    if (pinDownTimer != 0 && !first) {
-        cout << time - pinDownTimer << '\n';
-        if (time - pinDownTimer >= 2.f) {
-            if (throwNumber % 2 == 0 || score == 10) {
-                if (score == 10) {
-                    throwNumber++;
-                }
-                resetPinsAndBall({});
-                checked.clear();
-                for (int i = 0; i < 10; i++) {
-                    checked.push_back(false);
+    for (int i = 0; i < numPins; i++) {
+        pinFallen[i] = false;
+    }
+    pinsDownThisBall = 0;
+    throwTime = -1;
+    firstPinDownTime = -1;
+    replayRecorder.Discard();
+}
+
+void processSimCommands()
+{
+    SimCommand command;
+    while (simCommands.Pop(command)) {
+        switch (command.type) {
+        case SimCommandType::Throw:
+            moveHandle(command.aim, command.power);
+            if (throwTime < 0) {
+                throwTime = simulationTime;
+                beginReplay();
+            }
+            break;
+        case SimCommandType::Reset: {
+            // the ball is thrown again at the pins that were standing before it
+            vector<int> down;
+            for (int i = 0; i < numPins; i++) {
+                if (!bodyPins[i]) down.push_back(i);
+            }
+            resetPinsAndBall(down);
+            clearBall();
+            break;
+        }
+        }
+    }
+}
+
+void postScore()
+{
+    const Core::SessionBowler& bowler = Core::GetBowlerUp(session, sessionLane);
+    int frameTotals[Core::BowlingGame::numFrames];
+    Core::PostHudEvent(Core::HudField::Player, session.lanes[sessionLane].up + 1);
+    Core::PostHudEvent(Core::HudField::Frame, bowler.game.frame + 1);
+    Core::PostHudEvent(Core::HudField::Ball, bowler.game.ball + 1);
+    Core::PostHudEvent(Core::HudField::Score, Core::ScoreFrames(bowler.game, frameTotals));
+}
+
+// scores the ball and sets up the rack for the next one
+void finishBall()
+{
+    const Core::SessionBowler& up = Core::GetBowlerUp(session, sessionLane);
+    // all the pins that were standing went down: a strike or a spare
+    bool clearedRack = pinsDownThisBall > 0 && pinsDownThisBall == up.game.standing;
+    char replayName[64];
+    snprintf(replayName, sizeof(replayName), "game%u_roll%02d.rpl", up.gameId, up.game.numRolls + 1);
+    if (replayRecorder.IsRecording()) {
+        Core::ThrowReplay replay;
+        replayRecorder.Finish(replay);
+        if (clearedRack) {
+            InstantReplay& instant = instantReplays.Back();
+            instant.id = ++instantReplayCount;
+            instant.replay = replay;
+            instantReplays.Publish();
+        }
+        // saved by the writer thread, the simulation never waits for the disk
+        Core::QueueThrowReplay(move(replay), replayDirectory, replayName);
+    }
+
+    Core::SessionRoll roll = Core::AddSessionRoll(session, sessionLane, pinsDownThisBall);
+    const Core::SessionBowler& bowler = session.lanes[sessionLane].bowlers[roll.bowler];
+    if (roll.result != Core::RollResult::Accepted) {
+        Core::Log(Core::LogLevel::Warning, "%.16s, frame %d: %d pins down not accepted", bowler.name, roll.frame + 1, pinsDownThisBall);
+    }
+    Core::Log(Core::LogLevel::Info, "%.16s, frame %d: %d pins down, score %d", bowler.name, roll.frame + 1, pinsDownThisBall, roll.score);
+    Core::PostHudEvent(Core::HudField::PinsDown, pinsDownThisBall);
+    if (roll.gameOver) {
+        Core::Log(Core::LogLevel::Info, "%.16s: game over, final score %d", bowler.name, roll.score);
+    }
+
+    // a frame that is over leaves a full rack for the next bowler
+    if (Core::IsFreshRack(Core::GetBowlerUp(session, sessionLane).game)) {
+        resetPinsAndBall({});
+    }
+    else {
+        vector<int> down;
+        for (int i = 0; i < numPins; i++) {
+            if (!bodyPins[i] || pinFallen[i]) down.push_back(i);
+        }
+        resetPinsAndBall(down);
+    }
+    clearBall();
+    postScore();
+}
+
+void updateScore()
+{
+    double time = simulationTime;
+    for (int i = 0; i < numPins; i++) {
+        if (bodyPins[i] && !pinFallen[i] && abs(lane.pinPositions[i].x - bodyPins[i]->getGlobalPose().p.x) >= 0.01) {
+            pinFallen[i] = true;
+            pinsDownThisBall++;
+            if (firstPinDownTime < 0) firstPinDownTime = time;
+        }
+    }
+    if (firstPinDownTime >= 0) {
+        Core::Log(Core::LogLevel::Debug, "pins settling for %.2f s", time - firstPinDownTime);
+        if (time - firstPinDownTime >= pinSettleTime) finishBall();
+    }
+    else if (throwTime >= 0 && time - throwTime >= gutterBallTime) {
+        finishBall();
+    }
+}
+
+// Adaptive substepping: each fixed step is split into finer substeps only while the ball is fast
+// or close to the rack, or the pins are still tumbling, and goes back to one once they settle.
+bool adaptiveSubsteps = true;
+const int maxSubsteps = 4;
+const float substepBallSpeed = 8.f;
+const float substepRackDistance = 6.f;
+const float pinSettledSpeed = 0.5f;
+
+int chooseSubsteps()
+{
+    if (!adaptiveSubsteps) return 1;
+    if (bodyHandle) {
+        PxVec3 toRack = bodyHandle->getGlobalPose().p - PxVec3(lane.pinPositions[0].x, lane.pinPositions[0].y, lane.pinPositions[0].z);
+        if (bodyHandle->getLinearVelocity().magnitude() > substepBallSpeed || toRack.magnitude() < substepRackDistance) {
+            return maxSubsteps;
+        }
+    }
+    for (auto pin : pinsBody) {
+        if (!pin->isSleeping() && pin->getLinearVelocity().magnitude() > pinSettledSpeed) {
+            return maxSubsteps / 2;
+        }
+    }
+    return 1;
+}
+
+long long substepsTaken = 0;
+void stepPhysics()
+{
+    int substeps = chooseSubsteps();
+    if (physicsCounters.degradeLevel >= 1) {
+        substeps = min(substeps, 2);
+    }
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < substeps; i++) {
+        pxScene.step(physicsStepTime / substeps);
+    }
+    substepsTaken += substeps;
+    physicsCounters.steps++;
+    updateGovernor(chrono::duration<double>(Clock::now() - start).count());
+}
+
+// advances the simulation in fixed steps up to the given time and publishes the result
+void simulateUntil(double time)
+{
+    if (!capturing) {
+        PhysicsCounters& c = physicsCounters;
+        // in slow motion only part of the elapsed time is simulated, the rest is dropped
+        static double lastTime = time;
+        c.droppedTime += (time - lastTime) * (1.0 - simulationTimeScale());
+        lastTime = time;
+        time -= c.droppedTime;
+
+        // don't spiral: after maxCatchUpSteps the remaining whole steps are given up
+        double backlog = floor((time - simulationTime) / physicsStepTime) - maxCatchUpSteps;
+        if (backlog > 0) {
+            c.cappedUpdates++;
+            c.droppedTime += backlog * physicsStepTime;
+            time -= backlog * physicsStepTime;
+        }
+    }
+    while (simulationTime + physicsStepTime <= time) {
+        processSimCommands();
+        storePreviousPoses();
+        // here we perform the physics simulation step
+        stepPhysics();
+        simulationTime += physicsStepTime;
+        recordReplayStep();
+        updateScore();
+    }
+    publishSnapshot();
+}
+
+void runSimulation()
+{
+    while (simulationRunning.load()) {
+        simulateUntil(chrono::duration<double>(Clock::now() - simulationStart).count());
+        this_thread::sleep_until(simulationStart + chrono::duration_cast<Clock::duration>(chrono::duration<double>(physicsCounters.droppedTime + simulationTime + physicsStepTime)));
+    }
+}
+
+// --bench-substeps [throws]: replays the same set of throws headless with the fixed-rate and
+// the adaptive loop, and reports the step cost and how many pins fell in each
+void benchmarkSubsteps(int throws)
+{
+    const double throwDuration = 6.0;
+    // the benchmark steps as fast as it can, the governor would only get in the way
+    governorEnabled = false;
+    loadModels();
+    initPhysicsScene();
+
+    vector<int> pinsDown[2];
+    for (int mode = 0; mode < 2; mode++) {
+        adaptiveSubsteps = mode == 1;
+        substepsTaken = 0;
+        double stepSeconds = 0;
+        int totalDown = 0;
+        for (int t = 0; t < throws; t++) {
+            resetPinsAndBall({});
+            float aim = throws > 1 ? -0.2f + 0.4f * t / (throws - 1) : 0.f;
+            moveHandle(aim, -(300.f + 100.f * (t % 4)));
+
+            Clock::time_point start = Clock::now();
+            for (double time = 0; time < throwDuration; time += physicsStepTime) {
+                stepPhysics();
+            }
+            stepSeconds += chrono::duration<double>(Clock::now() - start).count();
+
+            int down = 0;
+            for (int i = 0; i < pinsBody.size(); i++) {
+                if (abs(startingPositions.at(i) - pinsBody.at(i)->getGlobalPose().p.x) >= 0.01) {
+                    down++;
                 }
-                leftButtonState = 3;
-                pinsDownIndexes.clear();
-                finalScore += score;
-                system("cls");
-                cout << "Throw number: " << throwNumber << '\n';
-                cout << "Round Score: " << score << '\n';
-                cout << "Final Score: " << finalScore << '\n';
-                score = 0;
             }
-            else {
-                resetPinsAndBall(pinsDownIndexes);
-                leftButtonState = 3;
-                system("cls");
-                cout << "Throw number: " << throwNumber << '\n';
-                cout << "First score: " << score << '\n';
+            pinsDown[mode].push_back(down);
+            totalDown += down;
+        }
+        Core::Log(Core::LogLevel::Info, "%s: %d throws, %lld physics steps, %.1f ms stepping (%.3f ms per simulated second), %d pins down",
+            adaptiveSubsteps ? "adaptive" : "fixed", throws, substepsTaken, stepSeconds * 1000.0,
+            stepSeconds * 1000.0 / (throws * throwDuration), totalDown);
+    }
+    for (int t = 0; t < throws; t++) {
+        if (pinsDown[0][t] != pinsDown[1][t]) {
+            Core::Log(Core::LogLevel::Info, "throw %d: fixed %d pins, adaptive %d pins", t, pinsDown[0][t], pinsDown[1][t]);
+        }
+    }
+    pxScene.allocator.report("physics memory", 10);
+}
+
+// --soak [resets]: sets up racks headless over and over (full ones and the partial ones of a
+// second throw, with a short roll of the ball in between) and checks that the live PhysX objects
+// and the physics memory stay flat; the exit code is 1 if anything kept growing
+int soakTest(int resets)
+{
+    const int stepsPerRack = 8;
+    governorEnabled = false;
+    loadModels();
+    initPhysicsScene();
+
+    unsigned seed = 1;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < resets; r++) {
+        vector<int> down;
+        if (r % 2) {
+            seed = seed * 1103515245u + 12345u;
+            for (int i = 0; i < numPins; i++) {
+                if ((seed >> (i + 8)) & 1) down.push_back(i);
             }
-            pinDownTimer = 0;
-            first = true;
-            throwNumber++;
         }
+        resetPinsAndBall(down);
+        moveHandle(0.f, -300.f);
+        for (int s = 0; s < stepsPerRack; s++) {
+            stepPhysics();
+        }
+        if ((r + 1) % 10000 == 0) {
+            Core::Log(Core::LogLevel::Info, "soak: %d resets in %.1f s, %d actors, %d shapes, %d meshes, %.1f KB physics memory",
+                r + 1, chrono::duration<double>(Clock::now() - start).count(), pxScene.auditor.getLiveCount(PhysicsAuditor::actors),
+                pxScene.auditor.getLiveCount(PhysicsAuditor::shapes), pxScene.auditor.getLiveCount(PhysicsAuditor::meshes),
+                pxScene.allocator.getLiveBytes() / 1024.0);
+        }
+    }
+    pxScene.auditor.report("physics audit", *pxScene.physics);
+    pxScene.allocator.report("physics memory", 10);
+    return pxScene.auditor.getGrowthCount() > 0 ? 1 : 0;
+}
+
+// moves the replay clock on, the playback loops after a second on the last pose
+void advanceReplay(double time)
+{
+    double elapsed = replayFrameTime < 0 ? 0 : time - replayFrameTime;
+    replayFrameTime = time;
+    if (!replayPaused) {
+        replayPosition += elapsed * replaySpeeds[replaySpeed];
+    }
+    if (replayPosition > replayPlayer.GetDuration() + 1.0) {
+        // an instant replay runs once, then the game goes on
+        if (instantReplay) {
+            endInstantReplay();
+            return;
+        }
+        replayPosition = 0;
+    }
+    if (instantReplay) {
+        orbitCamera((float)elapsed);
+    }
+}
+
+// places the ball and the pins as recorded, blended between the samples at any speed
+void showReplay()
+{
+    Core::RigidPose poses[Core::ThrowReplay::maxTracks];
+    replayPlayer.Sample((float)replayPosition, poses);
+    for (int t = 0; t < min(numReplayTracks, playbackReplay.numTracks); t++) {
+        if (playbackReplay.trackMask & (1u << t)) {
+            sceneStore.SetWorldPose(t == 0 ? ballEntity : pinEntities[t - 1], poses[t]);
+        }
+    }
+}
+
+int shownRackId = 0;
+int shownInstantReplayId = 0;
+void renderScene()
+{
+    // offscreen capture is driven by its frame clock, so the simulation is stepped right here
+    double time;
+    if (capturing) {
+        time = capturedFrames / captureFps;
+        if (!replaying) {
+            simulateUntil(time);
+        }
+    }
+    else {
+        time = chrono::duration<double>(Clock::now() - simulationStart).count();
+    }
+
+    Core::UpdateTextureStreaming();
+    if (shaderLoader.UpdateHotReload()) {
+        findTextureUniforms();
     }
+
+    const SceneSnapshot& snapshot = snapshots.Read();
+    if (snapshot.rackId != shownRackId) {
+        // a new rack is standing, the next throw can be charged
+        shownRackId = snapshot.rackId;
+        blocked = false;
+        leftButtonState = 3;
+    }
+    const InstantReplay& instant = instantReplays.Read();
+    if (instant.id != shownInstantReplayId) {
+        shownInstantReplayId = instant.id;
+        startInstantReplay(instant.replay);
+    }
+    if (replaying || instantReplay) {
+        advanceReplay(time);
+    }
+
     // Update of camera and perspective matrices
     if (vpress == 0) {
         cameraMatrix = view;
@@ -465,15 +1163,63 @@ void renderScene()
     }
     perspectiveMatrix = Core::createPerspectiveMatrix();
 
+    if (capturing) {
+        frameCapture.BeginFrame();
+    }
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glClearColor(0.0f, 0.1f, 0.3f, 1.0f);
 
-    // update transforms from physics simulation
-    updateTransforms();
+    // The snapshot ends at the last whole step, the leftover time until now decides how far
+    // to blend from the previous to the current poses (the picture lags by at most one step).
+    float alpha = glm::clamp((float)((time - snapshot.droppedTime - snapshot.time) / physicsStepTime), 0.f, 1.f);
 
-    // render models
-    for (Renderable* renderable : renderables) {
-        drawObjectTexture(renderable->model, renderable->physicsTransform * renderable->localTransform, renderable->textureId);
+    // only the entities with an actor in the snapshot are shown, e.g. knocked down pins are not
+    sceneStore.HideAll();
+    if (replaying || instantReplay) {
+        showReplay();
+    }
+    else {
+        for (int i = 0; i < snapshot.numObjects; i++) {
+            sceneStore.SetWorldPose(snapshot.objects[i].entity, interpolatePose(snapshot.objects[i].previousPose, snapshot.objects[i].pose, alpha));
+        }
+    }
+    for (Core::SceneHandle chunk : laneChunks) {
+        sceneStore.SetWorldPose(chunk, groundPose);
+    }
+    glm::mat4 viewProjection = perspectiveMatrix * cameraMatrix;
+    sceneTransforms.Compose(sceneStore.Size(), sceneStore.GetWorldPoses(), sceneStore.GetLocalTransforms(), viewProjection);
+    Core::Frustum frustum = Core::ExtractFrustum(viewProjection);
+    int drawnObjects = 0, culledObjects = 0, drawnTriangles = 0;
+
+    // render models straight from the packed arrays of the store
+    const int* modelIds = sceneStore.GetModelIds();
+    const int* textureLayers = sceneStore.GetTextureLayers();
+    const glm::mat4* modelMatrices = sceneTransforms.GetModelMatrices();
+    const glm::mat4* mvpMatrices = sceneTransforms.GetMvpMatrices();
+    const unsigned char* visible = sceneStore.GetVisible();
+    beginTexturedPass();
+    for (int i = 0; i < sceneStore.Size(); i++) {
+        if (!visible[i]) continue;
+        Core::LodMesh& mesh = meshes[modelIds[i]];
+        glm::vec3 center;
+        float radius;
+        Core::TransformBounds(mesh.bounds, modelMatrices[i], center, radius);
+        if (!Core::IsSphereVisible(frustum, center, radius)) {
+            culledObjects++;
+            continue;
+        }
+        // the level follows the share of the screen height the object covers
+        float depth = glm::max((viewProjection * glm::vec4(center, 1.f)).w, 0.1f);
+        const Core::PackedModel& model = mesh.levels[Core::SelectLod(mesh, radius * perspectiveMatrix[1][1] / depth)];
+        drawObjectTexture(model, modelMatrices[i], mvpMatrices[i], textureLayers[i]);
+        drawnObjects++;
+        drawnTriangles += Core::GetTriangleCount(model);
+    }
+    glUseProgram(0);
+    static double lastStatsTime = 0;
+    if (time - lastStatsTime > 5.0) {
+        lastStatsTime = time;
+        Core::Log(Core::LogLevel::Debug, "drawn %d objects (%d triangles), culled %d", drawnObjects, drawnTriangles, culledObjects);
     }
 
 
@@ -523,22 +1269,23 @@ void renderScene()
         glVertex2f(0.0, 2.f);
     }
     glEnd();
-    for (int i = 0; i < pinsBody.size(); i++) {
-        if (abs(startingPositions.at(i) - pinsBody.at(i)->getGlobalPose().p.x) >= 0.01 && !checked[i]) {
-            pinsDownIndexes.push_back(i);
-            score++;
-            checked[i] = true;
-            if (first) {
-                pinDownTimer = time;
-                first = false;
-            }
-        }
-    }
+    Core::DrawHud(10.f, 30.f);
     // Making sure we can render 3d again
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
     glMatrixMode(GL_MODELVIEW);
     glPopMatrix();
+
+    if (capturing) {
+        frameCapture.EndFrame();
+        if (++capturedFrames >= captureFrames) {
+            frameCapture.Finish();
+            // the idle callback may run once more before the loop returns
+            capturing = false;
+            glutLeaveMainLoop();
+        }
+        return;
+    }
     glutSwapBuffers();
 }
 
@@ -548,33 +1295,209 @@ void init()
     glEnable(GL_DEPTH_TEST);
     programColor = shaderLoader.CreateProgram("shaders/shader_color.vert", "shaders/shader_color.frag");
     programTexture = shaderLoader.CreateProgram("shaders/shader_tex.vert", "shaders/shader_tex.frag");
+    findTextureUniforms();
+    shaderLoader.WatchProgram(&programColor, "shaders/shader_color.vert", "shaders/shader_color.frag");
+    shaderLoader.WatchProgram(&programTexture, "shaders/shader_tex.vert", "shaders/shader_tex.frag");
 
     initRenderables();
     initPhysicsScene();
 
+    postScore();
 
+    publishSnapshot();
+    if (!capturing && !replaying) {
+        simulationStart = Clock::now();
+        simulationRunning = true;
+        simulationThread = thread(runSimulation);
+    }
 }
 
 void shutdown()
 {
+    if (simulationRunning.exchange(false)) {
+        simulationThread.join();
+    }
+    const PhysicsCounters& c = physicsCounters;
+    Core::Log(Core::LogLevel::Info, "physics: %lld steps, %.2f ms per step, %lld capped updates, %.2f s dropped, worst level: %s, %d level changes",
+        c.steps, c.stepCostEma * 1000.0, c.cappedUpdates, c.droppedTime, degradeLevelNames[c.peakDegradeLevel], c.levelChanges);
+    pxScene.auditor.report("physics audit", *pxScene.physics);
+    pxScene.allocator.report("physics memory", 10);
     shaderLoader.DeleteProgram(programColor);
     shaderLoader.DeleteProgram(programTexture);
+    Core::StopReplayWriter();
+    Core::StopScoreLog();
+    Core::StopLogger();
 }
 
 void idle()
 {
+    // freeglut doesn't call the display callback of the hidden window, the capture frames are drawn from here
+    if (capturing) {
+        renderScene();
+        return;
+    }
     glutPostRedisplay();
 }
 
+// "Ann,Bob" -> the bowlers in turn order, empty names are skipped
+vector<string> splitPlayers(const char* players)
+{
+    vector<string> names;
+    stringstream list(players);
+    string name;
+    while (getline(list, name, ',')) {
+        if (!name.empty()) names.push_back(name);
+    }
+    if (names.empty()) names.push_back("Player 1");
+    return names;
+}
+
+// --scores <bowler> [--score-log <file>]: prints the bowler's games from the score log to stdout
+// (not through the logger, which drops lines when a long history fills its queue)
+int printScores(const char* bowler)
+{
+    vector<Core::ScoreRecord> games;
+    if (!Core::ReadBowlerGames(scoreLogFile, bowler, games)) {
+        Core::Log(Core::LogLevel::Error, "can't read the score log %s", scoreLogFile);
+        return 1;
+    }
+    int finished = 0, total = 0;
+    for (const Core::ScoreRecord& game : games) {
+        time_t played = game.time;
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&played));
+        if (game.type == Core::ScoreRecordType::Game) {
+            printf("game %u, %s, lane %d: %d\n", game.gameId, date, game.lane, game.score);
+            finished++;
+            total += game.score;
+        }
+        else {
+            printf("game %u, %s, lane %d: %d after %d frames, not finished\n", game.gameId, date, game.lane, game.score, game.frames);
+        }
+    }
+    printf("%s: %d games finished, average %.1f\n", bowler, finished, finished ? (double)total / finished : 0.0);
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
+    Core::StartLogger();
+    // the lane is set up from the config in every mode
+    const char* laneConfigFile = "config/lane.cfg";
+    bool laneConfigGiven = false;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--lane-config") == 0) {
+            laneConfigFile = argv[i + 1];
+            laneConfigGiven = true;
+        }
+        else if (strcmp(argv[i], "--score-log") == 0) {
+            scoreLogFile = argv[i + 1];
+        }
+    }
+    // a mistyped --lane-config must not run a sweep with the default physics
+    if (!Core::LoadLaneConfig(lane, laneConfigFile, laneConfigGiven)) {
+        Core::StopLogger();
+        return 1;
+    }
+    // offline step: pack the scene textures into one block-compressed array with mipmaps and quit
+    if (argc > 1 && strcmp(argv[1], "--bake-textures") == 0) {
+        Core::PackTextureArray(textureFiles, numTextureLayers, textureLayerSize, packedTexturesFile);
+        Core::StopLogger();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-substeps") == 0) {
+        benchmarkSubsteps(argc > 2 ? max(1, atoi(argv[2])) : 20);
+        Core::StopLogger();
+        return 0;
+    }
+    if (argc > 2 && strcmp(argv[1], "--scores") == 0) {
+        int result = printScores(argv[2]);
+        Core::StopLogger();
+        return result;
+    }
+    if (argc > 1 && strcmp(argv[1], "--soak") == 0) {
+        int result = soakTest(argc > 2 ? max(1, atoi(argv[2])) : 100000);
+        Core::StopLogger();
+        return result;
+    }
     glutInit(&argc, argv);
+    // return from glutMainLoop() on window close, so shutdown() can flush the logger
+    glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
     glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
     glutInitWindowPosition(200, 200);
     glutInitWindowSize(1000, 1000);
     glutCreateWindow("Bowling game for computer graphics");
     glewInit();
 
+    // --capture <output> [--frames N] [--size WxH] [--fps F] [--sim-rate Hz] [--players A,B] [--lane N] [--replay <file>]
+    const char* captureOutput = nullptr;
+    const char* replayFile = nullptr;
+    const char* players = "Player 1";
+    int laneNumber = 1;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--sim-rate") == 0) {
+            int rate = atoi(argv[++i]);
+            if (rate != 60 && rate != 120 && rate != 240) {
+                Core::Log(Core::LogLevel::Error, "--sim-rate %s: the simulation runs at 60, 120 or 240 Hz", argv[i]);
+                Core::StopLogger();
+                return 1;
+            }
+            physicsStepTime = 1.0 / rate;
+        }
+        else if (strcmp(argv[i], "--capture") == 0) {
+            captureOutput = argv[++i];
+        }
+        else if (strcmp(argv[i], "--frames") == 0) {
+            captureFrames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--size") == 0) {
+            sscanf(argv[++i], "%dx%d", &captureWidth, &captureHeight);
+        }
+        else if (strcmp(argv[i], "--fps") == 0) {
+            captureFps = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--players") == 0) {
+            players = argv[++i];
+        }
+        else if (strcmp(argv[i], "--lane") == 0) {
+            laneNumber = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--replay") == 0) {
+            replayFile = argv[++i];
+        }
+    }
+    if (replayFile) {
+        if (!Core::LoadThrowReplay(playbackReplay, replayFile) || !replayPlayer.Open(playbackReplay)) {
+            Core::StopLogger();
+            return 1;
+        }
+        replaying = true;
+    }
+    // the game ids continue from the log, so it is started before the bowlers join
+    // without it every score of the session would be dropped
+    if (!Core::StartScoreLog(scoreLogFile)) {
+        Core::StopLogger();
+        return 1;
+    }
+    Core::StartReplayWriter();
+    sessionLane = Core::AddSessionLane(session, laneNumber);
+    for (const string& name : splitPlayers(players)) {
+        Core::AddSessionBowler(session, sessionLane, name.c_str());
+    }
+    if (captureOutput) {
+        // a batch run that can't write its frames is an error, not a reason to open the game window
+        if (!frameCapture.Init(captureWidth, captureHeight, captureOutput)) {
+            Core::StopReplayWriter();
+            Core::StopScoreLog();
+            Core::StopLogger();
+            return 1;
+        }
+        capturing = true;
+        // recordings should not depend on how fast this machine happens to be
+        governorEnabled = false;
+        glutHideWindow();
+    }
+
     init();
     glutKeyboardFunc(keyboard);
     glutPassiveMotionFunc(mouse);